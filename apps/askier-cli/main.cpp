@@ -1,13 +1,522 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <deque>
 #include <iostream>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QGuiApplication>
 #include <opencv2/core/ocl.hpp>
+#include <opencv2/videoio.hpp>
+#include <unistd.h>
+#include "askier/AsciiPipeline.hpp"
+#include "askier/AsciiRecording.hpp"
+#include "askier/Constants.hpp"
+#include "askier/GlyphDensityCalibrator.hpp"
+#include "askier/ImageUtils.hpp"
+#include "askier/MultiStreamEngine.hpp"
+#include "askier/QualityController.hpp"
+#include "askier/SharedFrameRing.hpp"
+#include "askier/TerminalPlayer.hpp"
+#include "askier/version.hpp"
 #include "util/util.hpp"
 
 
-int main() {
-    std::cout << std::boolalpha << "OpenCL available: " << cv::ocl::haveOpenCL() << std::endl;
+static const QCommandLineOption EDGES_OPTION({"e", "edges"}, "Edge operator: sobel, scharr, laplacian or none",
+                                            "operator", "sobel");
+static const QCommandLineOption EDGE_STRENGTH_OPTION("edge-strength", "Edge darkening in [0, 1]", "strength", "1");
+static const QCommandLineOption MATCHING_OPTION({"g", "glyph-matching"},
+                                               "Glyph selection: density, or structure for sharper line art",
+                                               "mode", "density");
+static const QCommandLineOption CHARSET_OPTION("charset", "Output characters: ascii, braille or blocks", "set",
+                                              "ascii");
+static const QCommandLineOption CONTRAST_OPTION(
+    "contrast", "Adaptive contrast of ASCII density matching: none, equalize or stretch", "mode", "none");
+static const QCommandLineOption NORMALIZATION_OPTION(
+    "normalization", "Edge range of video frames: minmax, running or previous", "mode", "minmax");
+
+/**
+ * Reads the conversion options into params, false on an unknown value.
+ */
+static bool parseConversionOptions(const QCommandLineParser &parser, AsciiParams &params) {
+    const QString name = parser.value(EDGES_OPTION).toLower();
+    if (name == "sobel") {
+        params.edgeOperator = EdgeOperator::Sobel;
+    } else if (name == "scharr") {
+        params.edgeOperator = EdgeOperator::Scharr;
+    } else if (name == "laplacian") {
+        params.edgeOperator = EdgeOperator::Laplacian;
+    } else if (name == "none") {
+        params.edgeOperator = EdgeOperator::None;
+    } else {
+        std::cerr << "Unknown edge operator " << name.toStdString() << std::endl;
+        return false;
+    }
+    params.edgeStrength = std::clamp(parser.value(EDGE_STRENGTH_OPTION).toFloat(), 0.0f, 1.0f);
+    const QString matching = parser.value(MATCHING_OPTION).toLower();
+    if (matching == "density") {
+        params.matching = GlyphMatching::Density;
+    } else if (matching == "structure") {
+        params.matching = GlyphMatching::Structure;
+    } else {
+        std::cerr << "Unknown glyph matching " << matching.toStdString() << std::endl;
+        return false;
+    }
+    const QString charset = parser.value(CHARSET_OPTION).toLower();
+    if (charset == "ascii") {
+        params.glyphSet = GlyphSet::Ascii;
+    } else if (charset == "braille") {
+        params.glyphSet = GlyphSet::Braille;
+    } else if (charset == "blocks") {
+        params.glyphSet = GlyphSet::Blocks;
+    } else {
+        std::cerr << "Unknown charset " << charset.toStdString() << std::endl;
+        return false;
+    }
+    const QString contrast = parser.value(CONTRAST_OPTION).toLower();
+    if (contrast == "none") {
+        params.toneRemap = ToneRemap::None;
+    } else if (contrast == "equalize") {
+        params.toneRemap = ToneRemap::Equalize;
+    } else if (contrast == "stretch") {
+        params.toneRemap = ToneRemap::Stretch;
+    } else {
+        std::cerr << "Unknown contrast " << contrast.toStdString() << std::endl;
+        return false;
+    }
+    // only video commands take the option, isSet would warn about it elsewhere
+    if (!parser.optionNames().contains(NORMALIZATION_OPTION.names().first())) {
+        return true;
+    }
+    const QString normalization = parser.value(NORMALIZATION_OPTION).toLower();
+    if (normalization == "minmax") {
+        params.edgeNormalization = EdgeNormalization::MinMax;
+    } else if (normalization == "running") {
+        params.edgeNormalization = EdgeNormalization::Running;
+    } else if (normalization == "previous") {
+        params.edgeNormalization = EdgeNormalization::PreviousFrame;
+    } else {
+        std::cerr << "Unknown edge normalization " << normalization.toStdString() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static int runConvert(const QStringList &arguments) {
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Convert an image to ASCII art");
+    parser.addHelpOption();
+    parser.addPositionalArgument("image", "Image to convert");
+    const QCommandLineOption columnsOption({"c", "columns"}, "Output columns", "columns", "480");
+    const QCommandLineOption fontOption({"f", "font"}, "Monospace font family", "family", "Monospace");
+    const QCommandLineOption sizeOption({"s", "size"}, "Font point size", "size",
+                                        QString::number(DEFAULT_FONT_SIZE));
+    const QCommandLineOption outputOption({"o", "output"}, "Output text file, stdout if omitted", "file");
+    const QCommandLineOption previewOption({"p", "preview"}, "Also save the rendered glyphs as an image", "file");
+    const QCommandLineOption adaptiveOption(
+        "adaptive", "Draw flat regions of the preview with larger glyphs, ASCII density matching only");
+    const QCommandLineOption layoutOption(
+        "layout", "With --adaptive, also write the layout as lines of column, row, scale and glyph", "file");
+    parser.addOptions({
+        columnsOption, fontOption, sizeOption, outputOption, previewOption, adaptiveOption, layoutOption,
+        EDGES_OPTION, EDGE_STRENGTH_OPTION, MATCHING_OPTION, CHARSET_OPTION, CONTRAST_OPTION
+    });
+    parser.process(arguments);
+
+    const QStringList positional = parser.positionalArguments();
+    if (positional.size() != 1) {
+        parser.showHelp(1);
+    }
+    QFont font(parser.value(fontOption), parser.value(sizeOption).toInt());
+    font.setStyleHint(QFont::Monospace);
+    AsciiParams params{
+        .columns = parser.value(columnsOption).toInt(),
+        .dithering = DitheringType::None,
+        .font = font,
+    };
+    if (!parseConversionOptions(parser, params)) {
+        return 1;
+    }
+    params.adaptiveCells = parser.isSet(adaptiveOption);
+
+    const auto calibrator = std::make_shared<GlyphDensityCalibrator>(params.font);
+    calibrator->ensureCalibrated();
+    // nothing is displayed, so decode straight to grayscale at reduced size
+    const cv::Mat image = loadImageForColumns(positional.first(), params.columns, calibrator->cellAspect(),
+                                              cellSamples(params), true);
+    if (image.empty()) {
+        std::cerr << "Failed to load image " << positional.first().toStdString() << std::endl;
+        return 1;
+    }
+    AsciiPipeline pipeline(calibrator);
+    const auto result = pipeline.process(image, params);
+
+    QFile file;
+    if (parser.isSet(outputOption)) {
+        file.setFileName(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+            std::cerr << "Failed to write " << file.fileName().toStdString() << std::endl;
+            return 1;
+        }
+    } else if (!file.open(stdout, QIODevice::WriteOnly | QIODevice::Text)) {
+        return 1;
+    }
+    const std::string text = result.glyphs.text();
+    if (file.write(text.data(), static_cast<qint64>(text.size())) != static_cast<qint64>(text.size())) {
+        std::cerr << "Failed to write " << file.fileName().toStdString() << std::endl;
+        return 1;
+    }
+    if (parser.isSet(previewOption) && !result.preview.save(parser.value(previewOption))) {
+        std::cerr << "Failed to write " << parser.value(previewOption).toStdString() << std::endl;
+        return 1;
+    }
+    if (!result.placements.empty()) {
+        std::cerr << "Adaptive layout: " << result.placements.size() << " glyphs for "
+                << result.glyphs.columns() * result.glyphs.rows() << " cells" << std::endl;
+    }
+    if (parser.isSet(layoutOption)) {
+        std::string layout;
+        for (const auto &placement: result.placements) {
+            layout += std::to_string(placement.column) + ' ' + std::to_string(placement.row) + ' ' +
+                    std::to_string(placement.scale) + ' ' + static_cast<char>(placement.code) + '\n';
+        }
+        QFile layoutFile(parser.value(layoutOption));
+        if (!layoutFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text) ||
+            layoutFile.write(layout.data(), static_cast<qint64>(layout.size())) != static_cast<qint64>(layout.size())) {
+            std::cerr << "Failed to write " << layoutFile.fileName().toStdString() << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int runRecord(const QStringList &arguments) {
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Record a video as an ASCII animation");
+    parser.addHelpOption();
+    parser.addPositionalArgument("video", "Video file to convert");
+    parser.addPositionalArgument("output", "Recording to write (.askr)");
+    const QCommandLineOption columnsOption({"c", "columns"}, "Output columns", "columns", "480");
+    const QCommandLineOption fontOption({"f", "font"}, "Monospace font family", "family", "Monospace");
+    const QCommandLineOption sizeOption({"s", "size"}, "Font point size", "size",
+                                        QString::number(DEFAULT_FONT_SIZE));
+    const QCommandLineOption budgetOption({"b", "budget"},
+                                          "Frame time budget in ms, lowers quality to hold it (0 disables)", "ms",
+                                          "0");
+    const QCommandLineOption motionOption({"m", "motion-threshold"},
+                                          "Gray level change below which frames repeat the previous one (0 disables)",
+                                          "levels", QString::number(MOTION_GATE_THRESHOLD));
+    const QCommandLineOption hysteresisOption({"y", "hysteresis"},
+                                              "Glyph hysteresis margin in LUT steps against flicker (0 disables)",
+                                              "steps", "0");
+    const QCommandLineOption threadsOption({"t", "threads"}, "Host threads of the pipeline (0 for one per core)",
+                                           "count", "0");
+    const QCommandLineOption cpusOption("cpus", "Comma separated CPUs the pipeline's threads are pinned to (Linux)",
+                                        "list");
+    const QCommandLineOption shmOption("shm", "Also publish the frames into a shared memory ring such as /askier",
+                                       "name");
+    const QCommandLineOption shmColorsOption("shm-colors", "Publish the mean color of each cell with the glyphs");
+    const QCommandLineOption shmPreviewOption("shm-preview", "Publish the rendered preview with the glyphs");
+    parser.addOptions({
+        columnsOption, fontOption, sizeOption, budgetOption, motionOption, hysteresisOption, threadsOption,
+        cpusOption, shmOption, shmColorsOption, shmPreviewOption, EDGES_OPTION, EDGE_STRENGTH_OPTION,
+        NORMALIZATION_OPTION, MATCHING_OPTION, CHARSET_OPTION, CONTRAST_OPTION
+    });
+    parser.process(arguments);
+
+    const QStringList positional = parser.positionalArguments();
+    if (positional.size() != 2) {
+        parser.showHelp(1);
+    }
+    QFont font(parser.value(fontOption), parser.value(sizeOption).toInt());
+    font.setStyleHint(QFont::Monospace);
+    AsciiParams params{
+        .columns = parser.value(columnsOption).toInt(),
+        .dithering = DitheringType::None,
+        .font = font,
+        .glyphHysteresis = parser.value(hysteresisOption).toFloat(),
+    };
+    if (!parseConversionOptions(parser, params)) {
+        return 1;
+    }
+    // the cell colors are a by-product of the color preview
+    params.colorPreview = parser.isSet(shmColorsOption);
+    const bool shmPreview = parser.isSet(shmPreviewOption);
+
+    cv::VideoCapture capture(positional[0].toStdString());
+    if (!capture.isOpened()) {
+        std::cerr << "Failed to open video " << positional[0].toStdString() << std::endl;
+        return 1;
+    }
+    const auto calibrator = std::make_shared<GlyphDensityCalibrator>(params.font);
+    calibrator->ensureCalibrated();
+    HostExecutorConfig hostConfig{.threads = parser.value(threadsOption).toInt()};
+    for (const auto &cpu: parser.value(cpusOption).split(',', Qt::SkipEmptyParts)) {
+        hostConfig.cpus.push_back(cpu.trimmed().toInt());
+    }
+    AsciiPipeline pipeline(calibrator, hostConfig);
+    pipeline.setMotionThreshold(parser.value(motionOption).toDouble());
+    std::unique_ptr<AsciiRecordingWriter> writer;
+    try {
+        writer = std::make_unique<AsciiRecordingWriter>(positional[1].toStdString(), params.glyphSet);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    // created with the first frame, which the quality controller has not scaled down yet
+    std::unique_ptr<SharedFrameWriter> shm;
+    bool shmFailed = false;
+    long long shmSkipped = 0;
+
+    QualityController quality(parser.value(budgetOption).toDouble());
+    int level = 0;
+    // results come out of the pipeline a few frames after their submission
+    std::deque<int64_t> timestamps;
+    const auto record = [&](const AsciiPipeline::Result &result) {
+        writer->push(asciiFrameFromGrid(result.glyphs, timestamps.front()), true);
+        if (parser.isSet(shmOption) && !shmFailed) {
+            const QImage preview = shmPreview ? result.preview : QImage();
+            if (!shm) {
+                const uint64_t slotBytes = static_cast<uint64_t>(result.glyphs.columns()) * result.glyphs.rows() *
+                                           (params.colorPreview ? 4 : 1) +
+                                           static_cast<uint64_t>(preview.width()) * preview.height() *
+                                           (params.colorPreview ? 3 : 1);
+                try {
+                    shm = std::make_unique<SharedFrameWriter>(parser.value(shmOption).toStdString(), slotBytes);
+                } catch (const std::exception &e) {
+                    std::cerr << e.what() << ", frames are recorded only" << std::endl;
+                    shmFailed = true;
+                }
+            }
+            if (shm && !shm->publish(result.glyphs, timestamps.front(), result.colors, preview)) {
+                ++shmSkipped;
+            }
+        }
+        timestamps.pop_front();
+        if (!result.repeated) {
+            quality.record(result.timings);
+        }
+        if (quality.enabled() && quality.level() != level) {
+            level = quality.level();
+            std::cerr << "Operating point: " << quality.describe().toStdString() << " at "
+                    << quality.averageMs() << "ms" << std::endl;
+        }
+    };
+    cv::Mat frame;
+    while (capture.read(frame)) {
+        timestamps.push_back(static_cast<int64_t>(capture.get(cv::CAP_PROP_POS_MSEC) * 1000.0));
+        if (const auto result = pipeline.submit(frame, quality.apply(params))) {
+            record(*result);
+        }
+        // the pipeline keeps the frame until it is collected
+        frame = cv::Mat();
+    }
+    for (const auto &result: pipeline.drain()) {
+        record(result);
+    }
+    try {
+        writer->close();
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    std::cerr << "Recorded " << writer->framesWritten() << " frames, " << writer->bytesWritten() << " bytes"
+            << std::endl;
+    if (shm) {
+        std::cerr << "Published " << shm->published() << " frames to " << shm->name() << ", " << shmSkipped
+                << " exceeded the ring's slots" << std::endl;
+    }
+    std::cerr << "Host arena: " << pipeline.hostExecutor().threads() << " threads, "
+            << 100.0 * pipeline.hostExecutor().utilization() << "% utilized" << std::endl;
+    if (pipeline.motionGate().enabled()) {
+        std::cerr << "Skipped " << pipeline.motionGate().skipped() << " static frames ("
+                << 100.0 * pipeline.motionGate().hitRate() << "%)" << std::endl;
+    }
+    if (quality.enabled()) {
+        std::cerr << "Final operating point: " << quality.describe().toStdString() << std::endl;
+    }
+    return 0;
+}
+
+/**
+ * Value of a comma separated per stream list for stream i, the last one
+ * applies to all further streams.
+ */
+static QString streamValue(const QStringList &values, const qsizetype i) {
+    return values.isEmpty() ? QString() : values[std::min(i, values.size() - 1)].trimmed().toLower();
+}
+
+static int runStreams(const QStringList &arguments) {
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Convert several videos or cameras at once and report their throughput");
+    parser.addHelpOption();
+    parser.addPositionalArgument("sources", "Video files, or camera indices", "sources...");
+    const QCommandLineOption columnsOption({"c", "columns"}, "Output columns, comma separated per source", "columns",
+                                           "160");
+    const QCommandLineOption ditheringOption({"d", "dithering"},
+                                             "Dithering per source, comma separated: none, floyd or ordered",
+                                             "dithering", "none");
+    const QCommandLineOption fontOption({"f", "font"}, "Monospace font family", "family", "Monospace");
+    const QCommandLineOption sizeOption({"s", "size"}, "Font point size", "size",
+                                        QString::number(DEFAULT_FONT_SIZE));
+    const QCommandLineOption batchOption("batch", "Frames converted together at most", "frames",
+                                         QString::number(MULTI_STREAM_MAX_BATCH));
+    const QCommandLineOption threadsOption({"t", "threads"}, "Host threads of the pipeline (0 for one per core)",
+                                           "count", "0");
+    parser.addOptions({
+        columnsOption, ditheringOption, fontOption, sizeOption, batchOption, threadsOption, EDGES_OPTION,
+        EDGE_STRENGTH_OPTION, NORMALIZATION_OPTION, MATCHING_OPTION, CHARSET_OPTION, CONTRAST_OPTION
+    });
+    parser.process(arguments);
+
+    const QStringList positional = parser.positionalArguments();
+    if (positional.isEmpty()) {
+        parser.showHelp(1);
+    }
+    QFont font(parser.value(fontOption), parser.value(sizeOption).toInt());
+    font.setStyleHint(QFont::Monospace);
+    AsciiParams common{.columns = 0, .dithering = DitheringType::None, .font = font};
+    if (!parseConversionOptions(parser, common)) {
+        return 1;
+    }
+
+    const auto calibrator = std::make_shared<GlyphDensityCalibrator>(font);
+    calibrator->ensureCalibrated();
+    MultiStreamEngine engine(GlyphEngine::create(calibrator),
+                             HostExecutorConfig{.threads = parser.value(threadsOption).toInt()},
+                             parser.value(batchOption).toInt());
+    const QStringList columns = parser.value(columnsOption).split(',', Qt::SkipEmptyParts);
+    const QStringList dithering = parser.value(ditheringOption).split(',', Qt::SkipEmptyParts);
+    struct Source {
+        cv::VideoCapture capture;
+        MultiStreamEngine::StreamId stream;
+        QString name;
+    };
+    std::vector<Source> sources;
+    for (qsizetype i = 0; i < positional.size(); ++i) {
+        bool camera = false;
+        const int index = positional[i].toInt(&camera);
+        cv::VideoCapture capture = camera ? cv::VideoCapture(index) : cv::VideoCapture(positional[i].toStdString());
+        if (!capture.isOpened()) {
+            std::cerr << "Failed to open " << positional[i].toStdString() << std::endl;
+            return 1;
+        }
+        AsciiParams params = common;
+        params.columns = streamValue(columns, i).toInt();
+        const QString ditheringName = streamValue(dithering, i);
+        if (ditheringName == "floyd") {
+            params.dithering = DitheringType::FloydSteinberg;
+        } else if (ditheringName == "ordered") {
+            params.dithering = DitheringType::Ordered;
+        } else if (ditheringName != "none") {
+            std::cerr << "Unknown dithering " << ditheringName.toStdString() << std::endl;
+            return 1;
+        }
+        sources.push_back({std::move(capture), engine.addStream(params), positional[i]});
+    }
+
+    const auto report = [&] {
+        for (const auto &source: sources) {
+            const auto stats = engine.stats(source.stream);
+            std::cerr << source.name.toStdString() << ": " << stats.frames << " frames, " << stats.fps << " fps, "
+                    << stats.latencyMs << "ms latency, " << stats.dropped << " dropped" << std::endl;
+        }
+        std::cerr << "Total: " << engine.throughput() << " fps" << std::endl;
+    };
+    auto lastReport = std::chrono::steady_clock::now();
+    size_t open = sources.size();
+    while (open > 0) {
+        for (auto &source: sources) {
+            if (!source.capture.isOpened()) {
+                continue;
+            }
+            // a new matrix per frame, the engine keeps the pending one referenced
+            cv::Mat frame;
+            if (source.capture.read(frame)) {
+                engine.push(source.stream, frame);
+            } else {
+                source.capture.release();
+                --open;
+            }
+        }
+        while (engine.hasPending()) {
+            (void) engine.step();
+        }
+        if (std::chrono::steady_clock::now() - lastReport > std::chrono::seconds(2)) {
+            report();
+            lastReport = std::chrono::steady_clock::now();
+        }
+    }
+    report();
+    return 0;
+}
+
+static std::atomic<bool> interrupted{false};
+
+static int runPlay(const QStringList &arguments) {
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Play an ASCII recording in the terminal");
+    parser.addHelpOption();
+    parser.addPositionalArgument("recording", "Recording to play (.askr)");
+    const QCommandLineOption fastOption({"x", "fast"}, "Play as fast as possible instead of the original timing");
+    parser.addOption(fastOption);
+    parser.process(arguments);
+
+    const QStringList positional = parser.positionalArguments();
+    if (positional.size() != 1) {
+        parser.showHelp(1);
+    }
+    try {
+        AsciiRecordingReader reader(positional.first().toStdString());
+        // restore the terminal on ctrl-c
+        std::signal(SIGINT, [](int) { interrupted = true; });
+        TerminalPlayer player(reader, STDOUT_FILENO);
+        const auto stats = player.play(!parser.isSet(fastOption), interrupted);
+        std::cerr << "Played " << stats.framesShown << " frames in " << stats.seconds << "s (" << stats.fps()
+                << " fps), dropped " << stats.framesDropped << ", wrote " << stats.bytesWritten << " bytes"
+                << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
     if (cv::ocl::haveOpenCL()) {
         cv::ocl::setUseOpenCL(true);
     }
-    const std::string opencl_device_descriptions = get_opencl_device_descriptions();
-    std::cout << opencl_device_descriptions << std::endl;
+    if (argc < 2) {
+        std::cout << std::boolalpha << "OpenCL available: " << cv::ocl::haveOpenCL() << std::endl;
+        const std::string opencl_device_descriptions = get_opencl_device_descriptions();
+        std::cout << opencl_device_descriptions << std::endl;
+        return 0;
+    }
+    // glyph calibration renders text, which needs a gui application but no display
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+    app.setApplicationName(QString(ASKIER_NAME).toLower());
+    app.setApplicationVersion(ASKIER_VERSION);
+
+    QStringList arguments = app.arguments();
+    const QString command = arguments.takeAt(1);
+    if (command == "convert") {
+        return runConvert(arguments);
+    }
+    if (command == "record") {
+        return runRecord(arguments);
+    }
+    if (command == "play") {
+        return runPlay(arguments);
+    }
+    if (command == "streams") {
+        return runStreams(arguments);
+    }
+    std::cerr << "Unknown command " << command.toStdString() << ", expected: convert, record, play, streams"
+            << std::endl;
+    return 1;
 }
@@ -0,0 +1,64 @@
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "askier/SharedFrameRing.hpp"
+
+
+/**
+ * Example consumer of the shared memory frame ring written by
+ * "askier-cli record --shm": attaches to the ring, and shows every new frame
+ * in the terminal. The frame is read in place and only shown when the writer
+ * did not reuse its slot meanwhile.
+ */
+
+static std::atomic<bool> interrupted{false};
+
+int main(int argc, char **argv) {
+    if (argc > 2 || (argc == 2 && argv[1][0] != '/')) {
+        std::cerr << "Usage: " << argv[0] << " [/name]" << std::endl;
+        return 1;
+    }
+    const std::string name = argc == 2 ? argv[1] : "/askier";
+    std::signal(SIGINT, [](int) { interrupted = true; });
+    try {
+        const SharedFrameReader reader(name);
+        uint64_t shown = 0;
+        long long frames = 0, missed = 0, torn = 0;
+        std::cout << "\x1b[?25l\x1b[2J";
+        while (!interrupted) {
+            if (reader.latest() == shown) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                continue;
+            }
+            std::string text;
+            SharedFrameView frame;
+            const bool valid = reader.readLatest([&](const SharedFrameView &view) {
+                frame = view;
+                text = GlyphGrid(view.columns, view.rows, view.columns, view.glyphs, nullptr, view.glyphSet).text();
+            });
+            if (!valid) {
+                ++torn;
+                continue;
+            }
+            // the writer may have published several frames since the last poll
+            if (shown != 0 && frame.sequence > shown + 1) {
+                missed += static_cast<long long>(frame.sequence - shown - 1);
+            }
+            shown = frame.sequence;
+            ++frames;
+            std::cout << "\x1b[H" << text << "frame " << frame.sequence << " at " << frame.timestampUs / 1000
+                    << "ms, " << frame.columns << "x" << frame.rows << (frame.colors ? ", colors" : "")
+                    << (frame.preview ? ", preview" : "") << "\x1b[K" << std::flush;
+        }
+        std::cout << "\x1b[0m\x1b[?25h" << std::endl;
+        std::cerr << "Showed " << frames << " frames, missed " << missed << ", discarded " << torn << " torn reads"
+                << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
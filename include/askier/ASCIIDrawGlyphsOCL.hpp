@@ -2,13 +2,70 @@
 #include <opencv2/core/mat.hpp>
 #include <opencv2/core/ocl.hpp>
 
+#include "askier/Constants.hpp"
+#include "askier/KernelAutotuner.hpp"
 
-[[nodiscard]] cv::Mat ascii_draw_glyphs_ocl(
+
+/**
+ * Enqueues drawing of each glyph's pixmap into its output cell, without
+ * waiting for the kernel to finish.
+ * @param usage allocation of the returned image
+ * @param config kernel variant and work-group size, see KernelAutotuner
+ * @param firstCode glyph code of the first pixmap in densePixmaps
+ * @return device image of glyphs.cols * outputCellWidth by glyphs.rows * outputCellHeight
+ */
+[[nodiscard]] cv::UMat ascii_draw_glyphs_ocl(
     cv::ocl::Context &context,
     const cv::UMat &glyphs,
     const cv::UMat &densePixmaps,
     const int pixmapWidth,
     const int pixmapHeight,
     const int outputCellWidth,
-    const int outputCellHeight
+    const int outputCellHeight,
+    cv::UMatUsageFlags usage = cv::USAGE_ALLOCATE_DEVICE_MEMORY,
+    const KernelLaunchConfig &config = {},
+    int firstCode = ASCII_MIN
+);
+
+/**
+ * Enqueues drawing of each glyph's pixmap into its output cell like
+ * ascii_draw_glyphs_ocl, with the ink in the cell's color over background, in
+ * a single pass. The per cell variants of config draw per pixel here.
+ * @param colors BGR color of each cell, CV_8UC3 of the size of glyphs
+ * @param background BGR color of the paper
+ * @return device BGR image of glyphs.cols * pixmapWidth by glyphs.rows * pixmapHeight
+ */
+[[nodiscard]] cv::UMat ascii_draw_glyphs_color_ocl(
+    cv::ocl::Context &context,
+    const cv::UMat &glyphs,
+    const cv::UMat &colors,
+    const cv::UMat &densePixmaps,
+    int pixmapWidth,
+    int pixmapHeight,
+    const cv::Vec3b &background,
+    cv::UMatUsageFlags usage = cv::USAGE_ALLOCATE_DEVICE_MEMORY,
+    const KernelLaunchConfig &config = {},
+    int firstCode = ASCII_MIN
+);
+
+/**
+ * Enqueues drawing of an adaptive layout, one work-item per output pixel
+ * reading the pixmap of the placement that covers its cell at the
+ * placement's scale. Like the color kernel it draws per pixel whatever the
+ * variant of config, only its work-group size applies.
+ * @param cover cover grid of ascii_adaptive_layout_ocl
+ * @param pixmaps2, pixmaps4 atlases of the glyphs at 2 and 4 times the pixmap size, see GlyphEngine::scaled
+ * @return device image of cover.cols * pixmapWidth by cover.rows * pixmapHeight
+ */
+[[nodiscard]] cv::UMat ascii_draw_placements_ocl(
+    cv::ocl::Context &context,
+    const cv::UMat &cover,
+    const cv::UMat &densePixmaps,
+    const cv::UMat &pixmaps2,
+    const cv::UMat &pixmaps4,
+    int pixmapWidth,
+    int pixmapHeight,
+    cv::UMatUsageFlags usage = cv::USAGE_ALLOCATE_DEVICE_MEMORY,
+    const KernelLaunchConfig &config = {},
+    int firstCode = ASCII_MIN
 );
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <opencv2/core/mat.hpp>
+#include <opencv2/core/ocl.hpp>
+
+#include "askier/Constants.hpp"
+
+
+/**
+ * Glyph of an adaptive layout, covering scale x scale cells of the glyph grid
+ * from column, row on
+ */
+struct GlyphPlacement {
+    uint16_t column = 0, row = 0;
+    uint8_t code = 0;
+    // 1, 2 or ADAPTIVE_CELL_MAX_SCALE
+    uint8_t scale = 1;
+};
+
+/**
+ * Device side adaptive layout
+ */
+struct AdaptiveLayout {
+    // CV_16UC4 placements (column, row, code, scale), a row of 16 per block of 4x4 cells; unused entries have
+    // scale 0
+    cv::UMat placements;
+    // CV_8UC4 per cell of the grid: code and scale of the placement covering it, and the cell's column and row
+    // within the placement
+    cv::UMat cover;
+    // CV_8U glyph codes of the uniform grid following the layout: cells of a coarse glyph repeat the 1x glyph of
+    // its mean luminance
+    cv::UMat glyphs;
+};
+
+/**
+ * Enqueues a quadtree over the glyph grid: each block of 4x4 cells becomes a
+ * single 4x glyph when flat, otherwise each of its 2x2 quadrants a 2x glyph
+ * when flat, otherwise the quadrant keeps its cells. A block is flat when
+ * the luminance of its cells and within each of them spreads less than
+ * flatness; partial blocks at the grid's border are never merged. Coarse
+ * glyphs are looked up from the block's mean luminance, and only the cells
+ * left at 1x are mapped, so the layout replaces the density mapper.
+ * @param cells CV_32F mean luminance per cell, undithered
+ * @param dithered CV_32F luminance the 1x cells are mapped from, may be cells itself
+ * @param meanSquares CV_32F mean squared luminance per cell, the variance inside a cell is meanSquares - cells^2
+ * @param lut1 density LUT of the engine
+ * @param lut2, lut4 density LUTs of the glyphs at 2 and 4 times the cell size, see GlyphEngine::scaled
+ * @param remap tone remap applied before every lookup, see ToneRemapState, empty maps linearly
+ * @return placements, cover grid and uniform glyphs of the layout
+ */
+[[nodiscard]] AdaptiveLayout ascii_adaptive_layout_ocl(cv::ocl::Context &context, const cv::UMat &cells,
+                                                       const cv::UMat &dithered, const cv::UMat &meanSquares,
+                                                       const cv::UMat &lut1, const cv::UMat &lut2,
+                                                       const cv::UMat &lut4,
+                                                       float flatness = ADAPTIVE_CELL_FLATNESS,
+                                                       cv::UMatUsageFlags usage = cv::USAGE_ALLOCATE_DEVICE_MEMORY,
+                                                       const cv::UMat &remap = cv::UMat());
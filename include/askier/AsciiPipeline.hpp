@@ -1,6 +1,25 @@
 #pragma once
+#include "AdaptiveLayoutOCL.hpp"
+#include "Constants.hpp"
+#include "EdgeNormalizationOCL.hpp"
 #include "GlyphDensityCalibrator.hpp"
+#include "GlyphEngineCache.hpp"
+#include "GlyphGrid.hpp"
+#include "GlyphHysteresisOCL.hpp"
+#include "HostExecutor.hpp"
+#include "KernelAutotuner.hpp"
+#include "MotionGate.hpp"
+#include "OclAsync.hpp"
+#include "StructureMatchOCL.hpp"
+#include "SubCellPackOCL.hpp"
+#include "ToneRemapOCL.hpp"
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <vector>
+#include <QColor>
 #include <QImage>
 #include <opencv2/core.hpp>
 #include <opencv2/core/ocl.hpp>
@@ -14,33 +33,362 @@ enum DitheringType {
 };
 
 
+enum class EdgeOperator {
+    None,
+    // magnitude of the 5x5 second derivatives
+    Sobel,
+    // magnitude of the 3x3 Scharr gradient
+    Scharr,
+    // absolute 3x3 Laplacian
+    Laplacian,
+};
+
+
+enum class GlyphMatching {
+    // mean cell darkness through the density sorted LUT
+    Density,
+    // nearest glyph by STRUCTURE_BLOCKS x STRUCTURE_BLOCKS sub-block luminance
+    Structure,
+};
+
+
 struct AsciiParams {
     int columns;
     DitheringType dithering;
     QFont font;
+    // darken edges by weighting with the complemented, normalized edge response
+    EdgeOperator edgeOperator = EdgeOperator::Sobel;
+    // fraction of the darkening applied, in [0, 1]
+    float edgeStrength = 1.0f;
+    // range the edge magnitude of submitted frames is normalized over, still images always use MinMax
+    EdgeNormalization edgeNormalization = EdgeNormalization::MinMax;
+    // temporal glyph hysteresis margin in LUT steps for submitted frames, 0 disables it; density matching only
+    float glyphHysteresis = 0.0f;
+    GlyphMatching matching = GlyphMatching::Density;
+    // characters of the output, matching only applies to ASCII
+    GlyphSet glyphSet = GlyphSet::Ascii;
+    // adaptive contrast from the histogram of the cell grid, density matching of ASCII only
+    ToneRemap toneRemap = ToneRemap::None;
+    // preview glyphs drawn in the mean color of their cell, BGR instead of grayscale
+    bool colorPreview = false;
+    // paper of the color preview
+    QColor previewBackground = QColor(Qt::white);
+    // flat regions drawn with glyphs of 2x2 or 4x4 cells, see Result::placements; still images with ASCII
+    // density matching and the grayscale preview only
+    bool adaptiveCells = false;
+
+    bool operator==(const AsciiParams &) const = default;
 };
 
+/**
+ * Luminance samples per glyph cell the pipeline resamples the image to: the
+ * sub-cells of the bit pattern glyph sets, STRUCTURE_BLOCKS x
+ * STRUCTURE_BLOCKS for structure matching, one for density matching
+ */
+[[nodiscard]] SubCellLayout cellSamples(const AsciiParams &params);
+
 class AsciiPipeline {
 public:
+    /**
+     * Host side milliseconds spent on a frame
+     */
+    struct Timings {
+        // staging and upload of the input
+        double uploadMs = 0.0;
+        // issuing the device work, including the syncs inside OpenCV calls
+        double computeMs = 0.0;
+        // blocked on the outputs
+        double waitMs = 0.0;
+        // copying the glyphs out of the slot's staging buffer
+        double textMs = 0.0;
+        // from submission until the result was collected
+        double latencyMs = 0.0;
+
+        /**
+         * Time the frame kept the calling thread busy
+         */
+        [[nodiscard]] double busyMs() const { return uploadMs + computeMs + waitMs + textMs; }
+    };
+
     struct Result {
-        std::vector<QString> lines;
+        // 8-bit glyph codes, shared with the mapped output on unified memory
+        GlyphGrid glyphs;
         QImage preview;
         QImage midImage; // intermediate image after grayscale and gamma correction
+        // mean BGR of each glyph cell, only with the color preview
+        QImage colors;
+        // glyphs of the adaptive layout the preview was drawn from, only with adaptive cells; glyphs follow it on
+        // the uniform grid, each cell of a coarse glyph holding the 1x glyph of the same luminance
+        std::vector<GlyphPlacement> placements;
+        Timings timings;
+        // output of the previous frame reused for a static one, see setMotionThreshold
+        bool repeated = false;
+    };
+
+    /**
+     * Frame of one of several independent sources, see processBatch
+     */
+    struct BatchFrame {
+        // BGR or single channel grayscale
+        cv::Mat bgr;
+        AsciiParams params;
+        // device state of the frame's source carried across its frames, fresh state if null
+        EdgeNormalizationState *normalization = nullptr;
+        ToneRemapState *tone = nullptr;
     };
 
-    explicit AsciiPipeline(const std::shared_ptr<GlyphDensityCalibrator> &calibrator);
+    /**
+     * Supplies rows [firstRow, firstRow + rowCount) of a BGR or grayscale
+     * source image.
+     * The returned matrix only has to stay valid until the next call.
+     */
+    using BandSource = std::function<cv::Mat(int firstRow, int rowCount)>;
+
+    /**
+     * @param hostConfig threads and CPUs of the task arena all host side work
+     * of the pipeline runs on, see HostExecutor
+     */
+    explicit AsciiPipeline(const std::shared_ptr<GlyphDensityCalibrator> &calibrator,
+                           const HostExecutorConfig &hostConfig = {});
+
+    explicit AsciiPipeline(const std::shared_ptr<const GlyphEngine> &engine,
+                           const HostExecutorConfig &hostConfig = {});
+
+    /**
+     * Runs the host side work on the task arena of another pipeline, see
+     * sharedHostExecutor. Pipelines converting at the same time then share
+     * the arena's threads instead of oversubscribing the cores.
+     */
+    AsciiPipeline(const std::shared_ptr<const GlyphEngine> &engine, const std::shared_ptr<HostExecutor> &sharedHost);
 
     /**
-     *
-     * @param bgr original image in BGR format
+     * Switches to the glyph data of another font, nothing is uploaded. The
+     * cell grid of the current input is kept and reused when the new cell
+     * aspect yields the same rows.
+     */
+    void setEngine(const std::shared_ptr<const GlyphEngine> &engine);
+
+    [[nodiscard]] const std::shared_ptr<const GlyphEngine> &glyphEngine() const { return engine; }
+
+    /**
+     * Intermediate stages are memoized for the last input, so calling again
+     * with the same cv::Mat buffer only reruns the stages downstream of the
+     * changed parameters: the grayscale pyramid depends on the input alone,
+     * edge weighting on the edge operator, strength and pyramid level, the
+     * cell grid on the output size, the dithered grid on the dithering and the
+     * glyph grid on the glyph engine. Inputs must not be modified in place
+     * between calls.
+     * Edges are computed on the pyramid level closest to
+     * EDGE_PYRAMID_CELL_SCALE times the cell resolution, so their cost scales
+     * with the output rather than the input.
+     * Images larger than TILED_PIXEL_THRESHOLD are converted band by band,
+     * see processTiled.
+     * @param bgr original image in BGR format, or single channel grayscale
      * @param params ASCII conversion parameters
      * @return result of the conversion
      */
     [[nodiscard]] Result process(const cv::Mat &bgr, const AsciiParams &params);
 
+    /**
+     * Asynchronous conversion for frame streams. The frame is staged in pinned
+     * memory, uploaded on a transfer queue and its kernels are enqueued without
+     * waiting; results are read back with non-blocking transfers. Up to
+     * ASYNC_PIPELINE_DEPTH frames are in flight, so the upload of one frame,
+     * the kernels of the previous one and the readback of the one before that
+     * overlap on the device. Stage memoization does not apply.
+     * On devices sharing memory with the host (CPU and integrated GPU) the
+     * frame is read in place and the outputs are mapped instead of copied;
+     * the returned images then share the mapped buffers.
+     * Frames the motion gate finds static skip all device work, their result
+     * repeats the previous one. With glyph hysteresis the glyph state carries
+     * over between frames and is reset on scene cuts. Running and
+     * PreviousFrame edge normalization keep the magnitude range on the device,
+     * which removes the host sync of the exact per frame range.
+     * @param bgr frame in BGR format, or single channel grayscale
+     * @param params ASCII conversion parameters
+     * @return result of the oldest frame in flight once the pipeline is full
+     */
+    [[nodiscard]] std::optional<Result> submit(const cv::Mat &bgr, const AsciiParams &params);
+
+    /**
+     * Converts frames of independent sources together, all on this pipeline's
+     * context and glyph engine. Every frame gets its own cell grid, dithering
+     * and edge weighting with its own parameters; frames of at most
+     * BATCH_MAX_GLYPH_CELLS cells whose grids are equally wide and drawn the
+     * same way are stacked and share one mapper, one draw launch and one
+     * readback, which amortizes the per launch overhead of small frames. All
+     * groups are enqueued before the first is waited for.
+     * Edge ranges are reduced on the device; MinMax frames use a fresh range.
+     * Glyph hysteresis and stage memoization do not apply, tone remapped
+     * frames are not stacked as their remap differs.
+     * @return results in the order of frames, empty for empty frames
+     */
+    [[nodiscard]] std::vector<Result> processBatch(const std::vector<BatchFrame> &frames);
+
+    /**
+     * Waits for all frames in flight and ends the stream, the next submitted
+     * frame is always processed.
+     * @return their results, oldest first
+     */
+    [[nodiscard]] std::vector<Result> drain();
+
+    /**
+     * Largest signature change of a submitted frame treated as static, see
+     * MotionGate. 0, the default, processes every frame.
+     */
+    void setMotionThreshold(double threshold);
+
+    [[nodiscard]] const MotionGate &motionGate() const { return motion; }
+
+    /**
+     * Task arena of the host side stages, for utilization reporting
+     */
+    [[nodiscard]] HostExecutor &hostExecutor() { return *host; }
+
+    [[nodiscard]] const std::shared_ptr<HostExecutor> &sharedHostExecutor() const { return host; }
+
+    /**
+     * Bounded memory conversion. The source is read in horizontal bands of
+     * whole cell rows plus an EDGE_KERNEL_HALO row halo, so only one band is
+     * resident on the device at a time. Each band is read once: its cell means
+     * of the grayscale and of the grayscale times the edge magnitude are
+     * appended along with the band's magnitude range, and the edge weighted
+     * cells are combined from them once the global range is known. Edges are
+     * computed at source resolution here, the halo covers every edge operator. Dithering, mapping and drawing then run
+     * on the assembled cell grid, which is bounded by the output size.
+     * @param sourceSize size of the full source image
+     * @param source reads bands of the source image
+     * @param params ASCII conversion parameters
+     * @param bandPixelBudget maximum number of source pixels per band
+     * @return result of the conversion
+     */
+    [[nodiscard]] Result processTiled(const cv::Size &sourceSize, const BandSource &source,
+                                      const AsciiParams &params,
+                                      long long bandPixelBudget = TILED_BAND_PIXEL_BUDGET);
+
+    [[nodiscard]] Result processTiled(const cv::Mat &bgr, const AsciiParams &params,
+                                      long long bandPixelBudget = TILED_BAND_PIXEL_BUDGET);
+
 private:
-    std::shared_ptr<GlyphDensityCalibrator> calibrator;
+    struct StageCache {
+        cv::Mat input;
+        // grayscale, each level half the size of the previous one
+        std::vector<cv::UMat> pyramid;
+        cv::UMat edgeWeighted, cells, dithered, glyphs;
+        EdgeOperator edgeOperator = EdgeOperator::None;
+        float edgeStrength = 0.0f;
+        int edgeLevel = -1;
+        DitheringType dithering = DitheringType::None;
+        ToneRemap toneRemap = ToneRemap::None;
+        bool colorPreview = false;
+        QColor previewBackground;
+        // mean BGR of each output cell, only for the color preview
+        cv::UMat colors;
+        // mean squared luminance of each cell, only for adaptive cells
+        cv::UMat meanSquares;
+        bool adaptiveCells = false;
+        std::shared_ptr<const GlyphEngine> glyphsEngine;
+        Result result;
+    };
+
+    [[nodiscard]] Result processStages(const cv::Mat &bgr, const AsciiParams &params);
+
+    [[nodiscard]] std::optional<Result> submitFrame(const cv::Mat &bgr, const AsciiParams &params);
+
+    [[nodiscard]] std::vector<Result> processFrames(const std::vector<BatchFrame> &frames);
+
+    [[nodiscard]] Result processBands(const cv::Size &sourceSize, const BandSource &source,
+                                      const AsciiParams &params, long long bandPixelBudget);
+
+    /**
+     * @param colors if set, receives the mean BGR of each cell of outputSize
+     * @param meanSquares if set, receives the mean squared luminance of each cell of outputSize
+     */
+    [[nodiscard]] cv::UMat tiledCells(const cv::Size &sourceSize, const BandSource &source,
+                                      const cv::Size &outputSize, const AsciiParams &params,
+                                      long long bandPixelBudget, cv::UMat *colors = nullptr,
+                                      cv::UMat *meanSquares = nullptr);
+
+    /**
+     * Device buffers of a frame are kept referenced until its reads completed,
+     * they must not return to OpenCV's pool while the transfer queue uses them.
+     */
+    struct FrameSlot {
+        // frame read in place on unified memory devices
+        cv::Mat source;
+        cv::UMat input, glyphs, colors, placements, preview, midImage;
+        // staging on discrete devices
+        PinnedHostBuffer upload, glyphsHost, colorsHost, placementsHost, previewHost, midImageHost;
+        cl::Event glyphsRead, colorsRead, placementsRead, previewRead, midImageRead;
+        // zero copy outputs on unified memory devices
+        std::shared_ptr<MappedUMat> glyphsMapped, colorsMapped, placementsMapped, previewMapped, midImageMapped;
+        std::chrono::steady_clock::time_point submitted;
+        Timings timings;
+        GlyphSet glyphSet = GlyphSet::Ascii;
+        // static frame, nothing was enqueued
+        bool repeat = false;
+    };
+
+    [[nodiscard]] cv::UMatUsageFlags outputUsage() const;
+
+    /**
+     * Enqueues the glyph selection of the cell grid, the grid holds sub-cells
+     * in structure matching.
+     * @param remap tone remap of density matching, see ToneRemapState
+     */
+    [[nodiscard]] cv::UMat mapGlyphs(const cv::UMat &cells, const AsciiParams &params,
+                                     const cv::UMat &remap = cv::UMat());
+
+    /**
+     * Enqueues the adaptive layout of a cell grid with the engine's scaled
+     * glyphs, which the first layout of an engine calibrates, in place of
+     * mapGlyphs.
+     * @param cells undithered cell luminance
+     * @param dithered cell luminance the 1x glyphs are mapped from
+     */
+    [[nodiscard]] AdaptiveLayout adaptiveLayout(const cv::UMat &cells, const cv::UMat &dithered,
+                                                const cv::UMat &meanSquares, const cv::UMat &remap);
+
+    /**
+     * Enqueues drawing and the non-blocking readback of glyphs, preview and
+     * intermediate image into the slot's pinned buffers.
+     * @param colors mean BGR of each glyph cell for the color preview, empty draws grayscale
+     * @param layout adaptive layout of the glyphs the preview is drawn from, empty draws the glyph grid
+     */
+    void enqueueOutputs(FrameSlot &slot, const cv::UMat &glyphs, const cv::UMat &cells, const cv::UMat &colors,
+                        const AsciiParams &params, const AdaptiveLayout &layout = AdaptiveLayout());
+
+    /**
+     * Waits for the slot's reads, each only right before its data is needed.
+     */
+    [[nodiscard]] Result collect(FrameSlot &slot);
+
+    /**
+     * collect for submitted frames, resolving repeats to the last streamed result
+     */
+    [[nodiscard]] Result collectStreamed(FrameSlot &slot);
+
+    // declared first, the arena outlives everything running on it
+    std::shared_ptr<HostExecutor> host;
+    StageCache stages;
+    cl::CommandQueue transferQueue;
+    FrameSlot syncSlot;
+    // one per stacked group of processBatch, kept for their pinned buffers
+    std::vector<FrameSlot> batchSlots;
+    std::vector<FrameSlot> slots;
+    // indices into slots, oldest first
+    std::deque<size_t> inFlight;
+    size_t nextSlot = 0;
+    MotionGate motion;
+    // parameters and engine the motion gate's reference frame was processed with
+    std::optional<AsciiParams> gatedParams;
+    std::shared_ptr<const GlyphEngine> gatedEngine;
+    Result streamResult;
+    GlyphHysteresisState glyphState;
+    EdgeNormalizationState streamNormalization;
+    ToneRemapState streamTone;
+    bool hostUnifiedMemory = false;
+    std::shared_ptr<const GlyphEngine> engine;
+    KernelLaunchConfig launchConfig;
     cv::ocl::Context clContext;
-    cv::UMat deviceLut, deviceDensePixmaps;
-    int pixmapHeight, pixmapWidth;
 };
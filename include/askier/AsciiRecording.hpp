@@ -0,0 +1,172 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "askier/Constants.hpp"
+#include "askier/GlyphGrid.hpp"
+
+/**
+ * One frame of an ASCII animation, a row major grid of 8-bit glyph codes and
+ * optionally a BGR color per cell.
+ */
+struct AsciiFrame {
+    int columns = 0, rows = 0;
+    int64_t timestampUs = 0;
+    std::vector<uint8_t> glyphs;
+    // empty or 3 bytes per cell
+    std::vector<uint8_t> colors;
+};
+
+/**
+ * How the glyph codes of a recording map to characters, stored as the
+ * GlyphSet value
+ */
+using RecordingCharset = GlyphSet;
+
+/**
+ * Frame holding a copy of the pipeline's glyph output.
+ */
+[[nodiscard]] AsciiFrame asciiFrameFromGrid(const GlyphGrid &grid, int64_t timestampUs);
+
+/**
+ * Streams frames to an .askr recording. All integers are little endian:
+ *
+ *   header  "ASKR", u16 version, u8 charset, u8 reserved flags
+ *   frame   u8 type, u8 flags, u16 columns, u16 rows, u32 payload size,
+ *           i64 timestamp in us, payload
+ *   index   per frame: u64 file offset, i64 timestamp in us, u32 keyframe
+ *   footer  u64 index offset, u32 frame count, "ASKI"
+ *
+ * Keyframe payloads hold the PackBits run length encoded glyph plane followed
+ * by the color plane, delta payloads the same for the XOR with the previous
+ * frame, so unchanged cells cost a few bits. A keyframe is written every
+ * keyframeInterval frames and whenever the grid size or color presence changes.
+ * Frames are encoded and written on a background thread.
+ */
+class AsciiRecordingWriter {
+public:
+    /**
+     * @throws std::runtime_error if the file cannot be created
+     */
+    explicit AsciiRecordingWriter(const std::string &path, RecordingCharset charset = RecordingCharset::Ascii,
+                                  int keyframeInterval = RECORDING_KEYFRAME_INTERVAL);
+
+    ~AsciiRecordingWriter();
+
+    AsciiRecordingWriter(const AsciiRecordingWriter &) = delete;
+
+    AsciiRecordingWriter &operator=(const AsciiRecordingWriter &) = delete;
+
+    /**
+     * Queues a frame for the writer thread. When the queue is full the frame
+     * is dropped and false returned, unless wait is set.
+     * @throws std::runtime_error if the grid exceeds 65535 columns or rows
+     */
+    bool push(AsciiFrame frame, bool wait = false);
+
+    /**
+     * Writes the queued frames, the index and the footer. Called by the
+     * destructor, which swallows errors.
+     * @throws std::runtime_error if writing failed
+     */
+    void close();
+
+    [[nodiscard]] size_t framesWritten() const { return written; }
+
+    [[nodiscard]] size_t framesDropped() const { return dropped; }
+
+    [[nodiscard]] uint64_t bytesWritten() const { return bytes; }
+
+    [[nodiscard]] RecordingCharset charset() const { return charsetCode; }
+
+private:
+    struct IndexEntry {
+        uint64_t offset;
+        int64_t timestampUs;
+        uint32_t keyframe;
+    };
+
+    void run();
+
+    void writeFrame(const AsciiFrame &frame);
+
+    void write(const std::vector<uint8_t> &data);
+
+    std::ofstream out;
+    RecordingCharset charsetCode;
+    int keyframeInterval;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<AsciiFrame> queue;
+    bool closing = false;
+    bool closed = false;
+    std::thread worker;
+
+    // owned by the writer thread until it is joined
+    AsciiFrame previous;
+    std::vector<IndexEntry> index;
+    uint32_t lastKeyframe = 0;
+    std::vector<uint8_t> record, plane;
+
+    std::atomic<size_t> written{0}, dropped{0};
+    std::atomic<uint64_t> bytes{0};
+};
+
+/**
+ * Reads .askr recordings. The index is loaded up front so any frame is
+ * located in constant time and decoded from its keyframe with at most
+ * keyframeInterval - 1 deltas; sequential reads apply a single delta.
+ * Recordings whose writer never closed them are indexed by scanning.
+ */
+class AsciiRecordingReader {
+public:
+    /**
+     * @throws std::runtime_error if the file is not a readable recording
+     */
+    explicit AsciiRecordingReader(const std::string &path);
+
+    [[nodiscard]] size_t frameCount() const { return index.size(); }
+
+    [[nodiscard]] int64_t timestampUs(size_t frame) const;
+
+    /**
+     * Last frame shown at the given time since the start of the recording
+     */
+    [[nodiscard]] size_t frameAt(int64_t timestampUs) const;
+
+    [[nodiscard]] RecordingCharset charset() const { return charsetCode; }
+
+    /**
+     * Decodes a frame, valid until the next call.
+     * @throws std::runtime_error if the frame is corrupt
+     */
+    const AsciiFrame &frame(size_t frame);
+
+private:
+    struct IndexEntry {
+        uint64_t offset;
+        int64_t timestampUs;
+        uint32_t keyframe;
+    };
+
+    bool readIndex(uint64_t fileSize);
+
+    void scanIndex(uint64_t fileSize);
+
+    void decode(size_t frame);
+
+    std::ifstream in;
+    RecordingCharset charsetCode = RecordingCharset::Ascii;
+    std::vector<IndexEntry> index;
+    AsciiFrame current;
+    size_t currentFrame = SIZE_MAX;
+    std::vector<uint8_t> payload, plane;
+};
@@ -2,7 +2,17 @@
 
 #include <opencv2/core.hpp>
 #include <opencv2/core/ocl.hpp>
+#include <array>
 
 
+/**
+ * Enqueues the mapping of cell luminance to glyphs through the LUT.
+ * @param usage allocation of the returned glyph grid
+ * @param localSize work-group size, {0, 0} leaves it to the driver
+ * @param remap tone remap applied to the luminance first, see ToneRemapState, empty maps linearly
+ */
 [[nodiscard]] cv::UMat ascii_mapper_ocl(cv::ocl::Context &context, const cv::UMat &src,
-                         const cv::UMat &deviceLut);
+                         const cv::UMat &deviceLut,
+                         cv::UMatUsageFlags usage = cv::USAGE_ALLOCATE_DEVICE_MEMORY,
+                         const std::array<size_t, 2> &localSize = {0, 0},
+                         const cv::UMat &remap = cv::UMat());
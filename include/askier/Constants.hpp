@@ -3,4 +3,83 @@
 constexpr int ASCII_MIN = 32; // space
 constexpr int ASCII_MAX = 126; // ~
 constexpr int ASCII_COUNT = ASCII_MAX - ASCII_MIN + 1;
-constexpr int DEFAULT_FONT_SIZE = 12;
\ No newline at end of file
+constexpr int DEFAULT_FONT_SIZE = 12;
+// Images above this many pixels are converted band by band (see AsciiPipeline::processTiled)
+constexpr long long TILED_PIXEL_THRESHOLD = 32LL * 1024 * 1024;
+// Source pixels resident on the device per band in tiled mode
+constexpr long long TILED_BAND_PIXEL_BUDGET = 8LL * 1024 * 1024;
+// Extra source rows above and below each band, radius of the largest edge kernel (5x5 Sobel)
+constexpr int EDGE_KERNEL_HALO = 2;
+// Lower bound of source pixels per output column kept by reduced decoding
+constexpr int MIN_SOURCE_PIXELS_PER_CELL = 2;
+// Device and host memory kept by GlyphEngineCache for fonts not in use
+constexpr long long GLYPH_ENGINE_CACHE_BYTES = 64LL * 1024 * 1024;
+// Frames in flight in AsciiPipeline::submit: upload, compute and readback of
+// consecutive frames overlap
+constexpr int ASYNC_PIPELINE_DEPTH = 3;
+// Frames between keyframes of an ASCII recording, bounds the deltas decoded per seek
+constexpr int RECORDING_KEYFRAME_INTERVAL = 120;
+// Frames queued for the recording writer thread before frames are dropped
+constexpr int RECORDING_QUEUE_FRAMES = 256;
+// Frames decoded ahead of the terminal by the playback worker
+constexpr int PLAYBACK_DECODE_AHEAD = 16;
+// Quality ladder of the frame budget controller: the fewest columns it steps
+// down to, and the factor between consecutive column steps
+constexpr int QUALITY_MIN_COLUMNS = 100;
+constexpr double QUALITY_COLUMN_STEP = 0.8;
+// Frames after a quality change before the controller may step down or up again
+constexpr int QUALITY_DOWNGRADE_FRAMES = 5;
+constexpr int QUALITY_UPGRADE_FRAMES = 30;
+// Fraction of the budget the frame time must stay below to step back up
+constexpr double QUALITY_UPGRADE_HEADROOM = 0.6;
+// Weight of the latest frame in the quality controller's frame time average
+constexpr double QUALITY_FRAME_TIME_SMOOTHING = 0.2;
+// Width in cells of the motion signature of a frame, see MotionGate
+constexpr int MOTION_SIGNATURE_WIDTH = 32;
+// Largest change of a signature cell, in 8-bit gray levels, still treated as static
+constexpr double MOTION_GATE_THRESHOLD = 6.0;
+// Glyph hysteresis margin in LUT steps enabled from the ui, see ascii_mapper_hysteresis_ocl
+constexpr float DEFAULT_GLYPH_HYSTERESIS = 0.75f;
+// Weight of the current frame in the per cell luminance smoothing of the hysteresis stage
+constexpr float GLYPH_HYSTERESIS_SMOOTHING = 0.5f;
+// Mean signature change in gray levels treated as a scene cut, resets temporal state
+constexpr double SCENE_CUT_THRESHOLD = 40.0;
+// Edges are computed on the smallest pyramid level at least this many times wider than the cell grid
+constexpr int EDGE_PYRAMID_CELL_SCALE = 3;
+// Weight of the current frame in the running edge magnitude range
+constexpr float EDGE_NORMALIZATION_SMOOTHING = 0.1f;
+// Host copies from this size on are split across the pipeline's task arena
+constexpr long long HOST_PARALLEL_COPY_BYTES = 1LL << 20;
+// Sub-blocks per cell side in structure matching, the kernels work on 4x4 = float16 features
+constexpr int STRUCTURE_BLOCKS = 4;
+constexpr int STRUCTURE_FEATURES = STRUCTURE_BLOCKS * STRUCTURE_BLOCKS;
+// Sub-cell luminance below which a braille dot or block quadrant is inked
+constexpr float SUBCELL_INK_THRESHOLD = 0.5f;
+// Luminance histogram bins of the adaptive tone remap, also the entries of the remap
+constexpr int TONE_REMAP_BINS = 256;
+// Weight of the current frame in the smoothed tone remap
+constexpr float TONE_REMAP_SMOOTHING = 0.1f;
+// Fraction of cells clipped at either end by the percentile stretch
+constexpr float TONE_REMAP_PERCENTILE = 0.01f;
+// Frames of at most this many glyph cells are stacked into shared kernel launches, see AsciiPipeline::processBatch
+constexpr int BATCH_MAX_GLYPH_CELLS = 40000;
+// Frames a MultiStreamEngine step converts at most, one per stream
+constexpr int MULTI_STREAM_MAX_BATCH = 8;
+// Weight of the latest frame in the per stream fps and latency averages
+constexpr double MULTI_STREAM_STATS_SMOOTHING = 0.1;
+// Span over which MultiStreamEngine counts the frames of its total throughput
+constexpr double MULTI_STREAM_THROUGHPUT_WINDOW_MS = 2000.0;
+// Slots of a shared memory frame ring, readers have all but one frame period to use a frame in place
+constexpr int SHARED_FRAME_SLOTS = 4;
+// Times a shared memory frame reader retries when the writer passed the frame it was about to read
+constexpr int SHARED_FRAME_READ_ATTEMPTS = 3;
+// Largest glyph of adaptive cells in font cells per side, flat regions take 2x2 or 4x4 cells in one glyph
+constexpr int ADAPTIVE_CELL_MAX_SCALE = 4;
+// Luminance spread, across the cells of a block and inside each of them, below which the block takes one glyph
+constexpr float ADAPTIVE_CELL_FLATNESS = 0.04f;
+// Interval at which the parameters dialog refreshes the preview of a still on a proxy while controls move
+constexpr int LIVE_PREVIEW_INTERVAL_MS = 30;
+// Pause in parameter changes after which the still is converted at full resolution in the background
+constexpr int LIVE_PREVIEW_SETTLE_MS = 300;
+// Proxy pixels per output column of the live preview, enough for edges at EDGE_PYRAMID_CELL_SCALE
+constexpr int LIVE_PREVIEW_PROXY_SCALE = 4;
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/ocl.hpp>
+
+
+/**
+ * Range the edge magnitude is normalized over before weighting
+ */
+enum class EdgeNormalization {
+    // exact range of the frame, read back to the host
+    MinMax,
+    // exponentially smoothed range, kept on the device
+    Running,
+    // range of the previous frame, kept on the device
+    PreviousFrame,
+};
+
+/**
+ * Magnitude range statistics resident on the device across frames.
+ */
+struct EdgeNormalizationState {
+    // reduction target, min and max as float bits, CV_32S
+    cv::UMat frameStats;
+    // applied min and max followed by the last frame's, CV_32F
+    cv::UMat stats;
+    // the next frame initializes the statistics with its own range
+    bool reset = true;
+};
+
+/**
+ * Enqueues weighted = gray * (1 - strength * normalized magnitude) without any
+ * host round trip: a work-group reduction gathers the magnitude range of the
+ * frame on the device, a single work-item folds it into the state according to
+ * mode and the weighting reads the result from there. MinMax is not supported
+ * here, it needs the host reduction.
+ * @param magnitude non-negative edge magnitude, same size as gray
+ */
+void edge_weight_normalized_ocl(cv::ocl::Context &context, const cv::UMat &gray, const cv::UMat &magnitude,
+                                EdgeNormalization mode, float strength, EdgeNormalizationState &state,
+                                cv::UMat &weighted);
@@ -15,6 +15,11 @@ class GlyphDensityCalibrator {
 public:
     explicit GlyphDensityCalibrator(const QFont &font);
 
+    /**
+     * Identifies the calibration of a font, family and point size
+     */
+    [[nodiscard]] static QString fontKey(const QFont &font);
+
     void ensureCalibrated();
 
     [[nodiscard]] const auto &lut() const { return lut_; }
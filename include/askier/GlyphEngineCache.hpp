@@ -0,0 +1,112 @@
+#pragma once
+#include <list>
+#include <memory>
+#include <mutex>
+#include <QFuture>
+#include <QString>
+#include <opencv2/core.hpp>
+
+#include "askier/Constants.hpp"
+#include "askier/GlyphDensityCalibrator.hpp"
+#include "askier/GlyphSet.hpp"
+#undef emit
+
+/**
+ * Calibrated glyph data of one font, resident on the device and ready to be
+ * shared by any number of pipelines.
+ */
+struct GlyphEngine {
+    std::shared_ptr<GlyphDensityCalibrator> calibrator;
+    cv::UMat deviceLut, deviceDensePixmaps;
+    // sub-block shape features per glyph for structure matching, see glyph_structure_features
+    cv::Mat features;
+    cv::UMat deviceFeatures;
+    // pixmaps of the bit pattern glyph sets at the font's cell size
+    cv::UMat deviceBraillePixmaps, deviceBlockPixmaps;
+    int pixmapWidth = 0, pixmapHeight = 0;
+
+    /**
+     * ASCII glyphs at a multiple of the cell size
+     */
+    struct ScaledGlyphs {
+        cv::UMat deviceLut, devicePixmaps;
+    };
+
+    /**
+     * Uploads the LUT and glyph pixmaps of an already calibrated calibrator,
+     * blocking until the uploads finished so the engine can be used from any
+     * thread's queue.
+     * @throws std::runtime_error if the glyph pixmaps differ in size
+     */
+    [[nodiscard]] static std::shared_ptr<const GlyphEngine> create(
+        const std::shared_ptr<GlyphDensityCalibrator> &calibrator);
+
+    /**
+     * The font calibrated at scale times its point size, with the pixmaps
+     * resampled to exactly scale times the engine's, for the coarse cells of
+     * adaptive layouts. Both scales are calibrated on the first call, once
+     * per engine, blocking; scale must be 2 or 4. Thread safe.
+     * @throws std::runtime_error if calibration fails, the next call retries
+     */
+    [[nodiscard]] const ScaledGlyphs &scaled(int scale) const;
+
+    /**
+     * Pixmap atlas of a glyph set, indexed by glyph code minus firstCode(set)
+     */
+    [[nodiscard]] const cv::UMat &devicePixmaps(GlyphSet set) const;
+
+    [[nodiscard]] static int firstCode(GlyphSet set) { return set == GlyphSet::Ascii ? ASCII_MIN : 0; }
+
+    /**
+     * Approximate memory held at creation, the pixmaps dominate. Scaled glyphs
+     * are only built for adaptive layouts and not counted.
+     */
+    [[nodiscard]] long long bytes() const;
+
+private:
+    // the font calibrated at 2 and 4 times its point size, see scaled
+    mutable std::once_flag scaledOnce;
+    mutable ScaledGlyphs scaled2, scaled4;
+};
+
+/**
+ * Least recently used cache of glyph engines keyed by font family and size.
+ * Engines are built at most once while cached, so switching between recently
+ * used fonts skips calibration, cache file parsing and the device upload.
+ * Engines beyond the memory cap are dropped from the cache, pipelines still
+ * using one keep it alive. Thread safe.
+ */
+class GlyphEngineCache {
+public:
+    explicit GlyphEngineCache(long long capacityBytes = GLYPH_ENGINE_CACHE_BYTES);
+
+    /**
+     * Returns the cached engine of the font or builds it, blocking.
+     * @throws std::runtime_error if calibration fails
+     */
+    [[nodiscard]] std::shared_ptr<const GlyphEngine> get(const QFont &font);
+
+    /**
+     * Same as get on the Qt global thread pool, for hot swapping engines
+     * without blocking the caller. The cache must outlive the future.
+     */
+    [[nodiscard]] QFuture<std::shared_ptr<const GlyphEngine>> getAsync(const QFont &font);
+
+    [[nodiscard]] std::shared_ptr<const GlyphEngine> find(const QFont &font);
+
+    [[nodiscard]] long long bytes() const;
+
+private:
+    struct Entry {
+        QString key;
+        std::shared_ptr<const GlyphEngine> engine;
+    };
+
+    void insert(const QString &key, const std::shared_ptr<const GlyphEngine> &engine);
+
+    mutable std::mutex mutex;
+    // most recently used first
+    std::list<Entry> entries;
+    long long capacityBytes;
+    long long usedBytes = 0;
+};
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "askier/GlyphSet.hpp"
+
+
+/**
+ * Row major grid of 8-bit glyph codes of a glyph set with a row stride, the
+ * text output of a conversion. Copies share the bytes, which are never modified once the grid
+ * was built.
+ */
+class GlyphGrid {
+public:
+    GlyphGrid() = default;
+
+    /**
+     * Grid over memory kept alive by owner, nothing is copied.
+     */
+    GlyphGrid(int columns, int rows, size_t stride, const uint8_t *data, std::shared_ptr<const void> owner,
+              GlyphSet set = GlyphSet::Ascii);
+
+    /**
+     * Grid holding a contiguous copy of the rows at data.
+     */
+    [[nodiscard]] static GlyphGrid copyOf(int columns, int rows, size_t stride, const uint8_t *data,
+                                          GlyphSet set = GlyphSet::Ascii);
+
+    /**
+     * Characters the codes stand for
+     */
+    [[nodiscard]] GlyphSet glyphSet() const { return set; }
+
+    [[nodiscard]] bool empty() const { return columns_ == 0 || rows_ == 0; }
+
+    [[nodiscard]] int columns() const { return columns_; }
+
+    [[nodiscard]] int rows() const { return rows_; }
+
+    /**
+     * Bytes from the start of one row to the next, at least columns()
+     */
+    [[nodiscard]] size_t stride() const { return stride_; }
+
+    [[nodiscard]] const uint8_t *data() const { return data_; }
+
+    [[nodiscard]] const uint8_t *row(const int y) const { return data_ + static_cast<size_t>(y) * stride_; }
+
+    /**
+     * Grid of rows [first, first + count), sharing the bytes.
+     * @throws std::out_of_range if the rows lie outside the grid
+     */
+    [[nodiscard]] GlyphGrid rowRange(int first, int count) const;
+
+    /**
+     * The rows as UTF-8 text, each terminated by a newline.
+     */
+    [[nodiscard]] std::string text() const;
+
+private:
+    int columns_ = 0, rows_ = 0;
+    size_t stride_ = 0;
+    const uint8_t *data_ = nullptr;
+    std::shared_ptr<const void> owner;
+    GlyphSet set = GlyphSet::Ascii;
+};
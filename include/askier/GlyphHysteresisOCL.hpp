@@ -0,0 +1,38 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/ocl.hpp>
+#include <array>
+
+
+/**
+ * Per cell state of the temporal glyph stage, resident on the device across
+ * frames.
+ */
+struct GlyphHysteresisState {
+    // LUT index of the glyph shown, CV_8U
+    cv::UMat index;
+    // smoothed luminance, CV_32F
+    cv::UMat luminance;
+    // the next frame initializes the state instead of filtering
+    bool reset = true;
+};
+
+/**
+ * Enqueues the mapping of cell luminance to glyphs with temporal hysteresis.
+ * Each cell's luminance is smoothed over frames and its glyph only changes once
+ * the smoothed value lies more than half a LUT step plus margin away from the
+ * glyph shown, so cells sitting on a LUT boundary stop flickering. The state
+ * is reinitialized when its size differs from src or reset is set.
+ * @param margin hysteresis in LUT steps
+ * @param smoothing weight of the current frame in the luminance average, 1 disables smoothing
+ * @param usage allocation of the returned glyph grid
+ * @param localSize work-group size, {0, 0} leaves it to the driver
+ * @param remap tone remap applied to the luminance before smoothing, empty maps linearly
+ */
+[[nodiscard]] cv::UMat ascii_mapper_hysteresis_ocl(cv::ocl::Context &context, const cv::UMat &src,
+                                                   const cv::UMat &deviceLut, GlyphHysteresisState &state,
+                                                   float margin, float smoothing,
+                                                   cv::UMatUsageFlags usage = cv::USAGE_ALLOCATE_DEVICE_MEMORY,
+                                                   const std::array<size_t, 2> &localSize = {0, 0},
+                                                   const cv::UMat &remap = cv::UMat());
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/**
+ * Characters the 8-bit glyph codes of a conversion stand for. Braille and
+ * Blocks codes are bit patterns of sub-cells, which resolve finer detail than
+ * a glyph per cell for the same number of characters.
+ */
+enum class GlyphSet : uint8_t {
+    // printable ASCII, codes are the characters themselves
+    Ascii = 0,
+    // 2x4 dots per cell, codes are the U+2800 dot pattern
+    Braille = 1,
+    // 2x2 quadrants per cell, codes are bit 0 top left, 1 top right, 2 bottom left, 3 bottom right
+    Blocks = 2,
+};
+
+/**
+ * Sub-cells per cell of a bit pattern set, 1x1 for ASCII
+ */
+struct SubCellLayout {
+    int columns = 1, rows = 1;
+};
+
+[[nodiscard]] SubCellLayout glyphSetLayout(GlyphSet set);
+
+/**
+ * Unicode code point of a glyph code, unknown ASCII codes become a space.
+ */
+[[nodiscard]] char32_t glyphCodepoint(GlyphSet set, uint8_t code);
+
+/**
+ * Appends the UTF-8 encoding of a glyph code.
+ */
+void appendGlyphUtf8(std::string &out, GlyphSet set, uint8_t code);
+
+/**
+ * Pixmaps of every code of a bit pattern set in code order, ink 0 on paper
+ * 255, drawn from the sub-cell layout rather than a font so any font's cell
+ * size works. Empty for ASCII, whose pixmaps come from calibration.
+ */
+[[nodiscard]] std::vector<uint8_t> renderGlyphSetPixmaps(GlyphSet set, int cellWidth, int cellHeight);
+
+/**
+ * Number of codes in the atlas of renderGlyphSetPixmaps
+ */
+[[nodiscard]] int glyphSetCodeCount(GlyphSet set);
@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <oneapi/tbb/task_arena.h>
+
+struct HostExecutorConfig {
+    // threads including the calling one, 0 for one per available core
+    int threads = 0;
+    // CPUs the worker threads are pinned to, empty leaves placement to the OS.
+    // Only supported on Linux, ignored elsewhere.
+    std::vector<int> cpus;
+};
+
+/**
+ * Task arena owned by a pipeline for its host side work. Everything run
+ * through execute, including OpenCV's own parallel loops when OpenCV uses
+ * TBB, stays on the arena's threads instead of the global pool, so the
+ * camera and ui threads keep their cores and no thread is created per frame.
+ * Optionally the arena's worker threads are pinned to a set of CPUs.
+ */
+class HostExecutor {
+public:
+    explicit HostExecutor(const HostExecutorConfig &config = {});
+
+    ~HostExecutor();
+
+    HostExecutor(const HostExecutor &) = delete;
+
+    HostExecutor &operator=(const HostExecutor &) = delete;
+
+    /**
+     * Runs f on the arena, the calling thread joins it until f returned.
+     */
+    template<typename F>
+    decltype(auto) execute(F &&f) {
+        return arena.execute(std::forward<F>(f));
+    }
+
+    /**
+     * memcpy split across the arena's threads from HOST_PARALLEL_COPY_BYTES on
+     */
+    void parallelCopy(void *destination, const void *source, size_t bytes);
+
+    [[nodiscard]] int threads() const { return concurrency; }
+
+    /**
+     * Fraction of the arena's thread time spent inside the arena since the
+     * last reset, including the calling thread's.
+     */
+    [[nodiscard]] double utilization() const;
+
+    void resetUtilization();
+
+private:
+    class Observer;
+
+    tbb::task_arena arena;
+    int concurrency = 1;
+    std::unique_ptr<Observer> observer;
+    std::atomic<int64_t> busyNs{0};
+    std::chrono::steady_clock::time_point since = std::chrono::steady_clock::now();
+};
@@ -1,8 +1,59 @@
 #pragma once
 
+#include <memory>
 #include <QImage>
+#include <QString>
 #include <opencv2/core.hpp>
 
+#include "askier/GlyphSet.hpp"
+
+/**
+ * Wraps data in a QImage without copying. owner is kept alive until the image
+ * and all its implicitly shared copies are gone.
+ */
+QImage wrapInQImage(const std::shared_ptr<const void> &owner, const uchar *data, int width, int height,
+                    qsizetype bytesPerLine, QImage::Format format);
+
+/**
+ * The image shares the matrix buffer and holds a reference to it, nothing is
+ * copied. Call QImage::copy when the buffer is about to be reused.
+ */
 QImage matToQImage(const cv::Mat &bgr);
 
-QImage matToQImageGray(const cv::Mat &gray);
\ No newline at end of file
+QImage matToQImageGray(const cv::Mat &gray);
+
+/**
+ * Largest power of two reduction (1, 2, 4 or 8) of an image of sourceSize
+ * that still leaves MIN_SOURCE_PIXELS_PER_CELL source pixels per cell in both
+ * directions for the given number of columns and cell aspect, and at least
+ * one per sample of the cell.
+ * @param samples luminance samples per cell, see cellSamples
+ */
+int reducedDecodeFactor(const cv::Size &sourceSize, int columns, double cellAspect, const SubCellLayout &samples);
+
+/**
+ * Decodes an image at 1/factor of its resolution. JPEG files are scaled in the
+ * DCT domain by libjpeg through the IMREAD_REDUCED_* flags, other formats are
+ * decoded and then downsampled by OpenCV.
+ * @param path image file
+ * @param factor 1, 2, 4 or 8
+ * @param grayscale decode to a single channel instead of BGR
+ * @return decoded image, empty on failure
+ */
+cv::Mat loadReducedImage(const QString &path, int factor, bool grayscale);
+
+/**
+ * Reads the image header only and decodes at the smallest resolution that
+ * still satisfies the requested columns, see reducedDecodeFactor.
+ * @param path image file
+ * @param columns output columns
+ * @param cellAspect glyph cell height / width
+ * @param samples luminance samples per cell, see cellSamples
+ * @param grayscale decode to a single channel instead of BGR
+ * @param factor if not null receives the reduction that was applied
+ * @param sourceSize if not null receives the full size the reduction was chosen for, after the EXIF
+ *        orientation; compare against it rather than the decoded size times the factor, which is rounded
+ * @return decoded image, empty on failure
+ */
+cv::Mat loadImageForColumns(const QString &path, int columns, double cellAspect, const SubCellLayout &samples,
+                            bool grayscale, int *factor = nullptr, cv::Size *sourceSize = nullptr);
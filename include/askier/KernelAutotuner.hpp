@@ -0,0 +1,66 @@
+#pragma once
+#include <array>
+#include <memory>
+#include <QString>
+#include <opencv2/core/ocl.hpp>
+
+#include "askier/GlyphEngineCache.hpp"
+#undef emit
+
+/**
+ * Ways of drawing glyph pixmaps into the preview image
+ */
+enum class GlyphDrawVariant {
+    // one work-item copies a whole pixmap, byte by byte
+    PerCell,
+    // one work-item copies a whole pixmap, row by row with vload8/vstore8
+    PerCellVector,
+    // one work-item per output pixel
+    PerPixel,
+    // one work-item per output pixel, the pixmap atlas staged in local memory
+    PerPixelLocalAtlas,
+};
+
+/**
+ * Launch configuration of the project's kernels. A local size of {0, 0} leaves
+ * the work-group size to the driver.
+ */
+struct KernelLaunchConfig {
+    GlyphDrawVariant drawVariant = GlyphDrawVariant::PerCell;
+    std::array<size_t, 2> drawLocalSize{0, 0};
+    std::array<size_t, 2> mapLocalSize{0, 0};
+};
+
+/**
+ * Runs a 2D kernel with an optional local size, the global size is rounded up
+ * to a multiple of it. A local size above the kernel's work-group limit is
+ * left to the driver instead. Kernels must bounds check their global ids.
+ */
+bool runKernel2D(cv::ocl::Kernel &kernel, size_t cols, size_t rows, const std::array<size_t, 2> &localSize,
+                 bool sync);
+
+/**
+ * Benchmarks the glyph draw variants and the work-group sizes of the mapper and
+ * draw kernels on the default OpenCL device. The winning configuration is
+ * persisted in the application data directory, keyed by device name and driver
+ * version, and reused on later runs.
+ */
+class KernelAutotuner {
+public:
+    /**
+     * Configuration for the default device, loaded from the tuning cache or
+     * benchmarked with the engine's glyph data and then saved.
+     */
+    [[nodiscard]] static KernelLaunchConfig tuned(cv::ocl::Context &context, const GlyphEngine &engine);
+
+    /**
+     * Whether variant can run with the engine's pixmaps on the context's device
+     */
+    [[nodiscard]] static bool supported(const cv::ocl::Context &context, GlyphDrawVariant variant,
+                                        const GlyphEngine &engine);
+
+private:
+    static KernelLaunchConfig benchmark(cv::ocl::Context &context, const GlyphEngine &engine);
+
+    static QString deviceKey(const cv::ocl::Context &context);
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <opencv2/core.hpp>
+
+#include "askier/Constants.hpp"
+
+/**
+ * Early out for static scenes. Each frame is reduced to a grayscale signature
+ * MOTION_SIGNATURE_WIDTH cells wide by area averaging, which cancels sensor
+ * noise but keeps small moving objects. A frame whose signature stays within
+ * the threshold of the last frame let through everywhere is static. Comparing
+ * with the last frame let through, not the previous one, lets slow drifts
+ * accumulate until they pass.
+ */
+class MotionGate {
+public:
+    /**
+     * @param threshold largest per cell change in gray levels, 0 disables the gate
+     */
+    explicit MotionGate(double threshold = 0.0);
+
+    void setThreshold(double threshold);
+
+    [[nodiscard]] double threshold() const { return maxChange; }
+
+    [[nodiscard]] bool enabled() const { return maxChange > 0.0; }
+
+    /**
+     * Whether the frame changed since the last one let through, which it then
+     * replaces. Always true while disabled or after reset.
+     */
+    [[nodiscard]] bool changed(const cv::Mat &bgr);
+
+    /**
+     * Whether the last frame let through differs from the one before on
+     * average by more than SCENE_CUT_THRESHOLD gray levels. Also tracked while
+     * the gate is disabled.
+     */
+    [[nodiscard]] bool sceneCut() const { return cut; }
+
+    /**
+     * Lets the next frame through, e.g. when the output parameters changed.
+     */
+    void reset();
+
+    [[nodiscard]] size_t frames() const { return frameCount; }
+
+    [[nodiscard]] size_t skipped() const { return skippedCount; }
+
+    /**
+     * Fraction of frames found static
+     */
+    [[nodiscard]] double hitRate() const;
+
+private:
+    double maxChange;
+    cv::Mat reference, small, signature;
+    size_t frameCount = 0, skippedCount = 0;
+    bool cut = false;
+};
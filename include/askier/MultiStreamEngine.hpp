@@ -0,0 +1,131 @@
+#pragma once
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "askier/AsciiPipeline.hpp"
+#include "askier/Constants.hpp"
+#include "askier/GlyphEngineCache.hpp"
+#include "askier/HostExecutor.hpp"
+
+
+/**
+ * Converts the frames of several concurrent sources, such as cameras or video
+ * files, on a single AsciiPipeline: one device context, one task arena and
+ * one resident copy of the glyph engine serve all streams.
+ * Sources push frames from any thread; each step takes the newest pending
+ * frame of up to maxBatchFrames streams, starting after the stream served
+ * last, so every stream gets its turn however fast the others push. The
+ * frames of a step go through AsciiPipeline::processBatch, which stacks small
+ * ones into shared kernel launches. Each stream keeps its own parameters and
+ * edge range and tone remap state on the device.
+ */
+class MultiStreamEngine {
+public:
+    using StreamId = int;
+
+    struct StreamStats {
+        long long frames = 0;
+        // pending frames replaced by a newer one before their turn
+        long long dropped = 0;
+        // smoothed over frames with MULTI_STREAM_STATS_SMOOTHING
+        double fps = 0.0;
+        // from push until the result was returned
+        double latencyMs = 0.0;
+    };
+
+    struct StreamResult {
+        StreamId stream;
+        AsciiPipeline::Result result;
+    };
+
+    /**
+     * @param maxBatchFrames frames converted per step at most
+     */
+    explicit MultiStreamEngine(const std::shared_ptr<const GlyphEngine> &engine,
+                               const HostExecutorConfig &hostConfig = {},
+                               int maxBatchFrames = MULTI_STREAM_MAX_BATCH);
+
+    /**
+     * Thread safe.
+     */
+    StreamId addStream(const AsciiParams &params);
+
+    /**
+     * Drops the stream and its pending frame. Thread safe.
+     */
+    void removeStream(StreamId stream);
+
+    /**
+     * Applies from the next frame converted. Thread safe.
+     */
+    void setParams(StreamId stream, const AsciiParams &params);
+
+    /**
+     * Queues a frame of the stream, replacing the pending one if it was not
+     * converted yet: live sources only need their newest frame. The frame is
+     * referenced, not copied, and must not be modified afterwards. Thread safe.
+     * @throws std::out_of_range for unknown streams
+     */
+    void push(StreamId stream, const cv::Mat &bgr);
+
+    /**
+     * Converts the pending frames of the next streams in turn, blocking. Call
+     * from a single thread.
+     * @return results in the order the frames were taken, empty if no frame was pending
+     */
+    [[nodiscard]] std::vector<StreamResult> step();
+
+    [[nodiscard]] bool hasPending() const;
+
+    /**
+     * Thread safe.
+     * @throws std::out_of_range for unknown streams
+     */
+    [[nodiscard]] StreamStats stats(StreamId stream) const;
+
+    /**
+     * Frames per second over all streams, counted over the last
+     * MULTI_STREAM_THROUGHPUT_WINDOW_MS. Thread safe.
+     */
+    [[nodiscard]] double throughput() const;
+
+    [[nodiscard]] std::vector<StreamId> streams() const;
+
+    [[nodiscard]] AsciiPipeline &pipeline() { return pipeline_; }
+
+private:
+    struct Stream {
+        AsciiParams params;
+        cv::Mat pending;
+        std::chrono::steady_clock::time_point pushed;
+        std::chrono::steady_clock::time_point lastResult;
+        StreamStats stats;
+        // touched by step only
+        std::optional<AsciiParams> convertedParams;
+        EdgeNormalizationState normalization;
+        ToneRemapState tone;
+    };
+
+    /**
+     * Drops completion times older than the throughput window, under the lock
+     */
+    void pruneCompleted(const std::chrono::steady_clock::time_point &now) const;
+
+    AsciiPipeline pipeline_;
+    int maxBatchFrames;
+    mutable std::mutex mutex;
+    // shared so a stream removed during a step stays valid until the step ends
+    std::map<StreamId, std::shared_ptr<Stream> > streams_;
+    StreamId nextId = 0;
+    // streams from this id on are served first in the next step
+    StreamId nextTurn = 0;
+    // when each frame of the throughput window was returned, oldest first
+    mutable std::deque<std::chrono::steady_clock::time_point> completed;
+    std::optional<std::chrono::steady_clock::time_point> firstResult;
+};
@@ -0,0 +1,117 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <CL/opencl.hpp>
+#include <opencv2/core/mat.hpp>
+
+/**
+ * Host memory allocated by the OpenCL runtime (CL_MEM_ALLOC_HOST_PTR) and kept
+ * mapped for its whole lifetime. On discrete GPUs this memory is page locked,
+ * so reads and writes through it are plain DMA transfers and can run
+ * asynchronously next to kernels.
+ */
+class PinnedHostBuffer {
+public:
+    PinnedHostBuffer() = default;
+
+    ~PinnedHostBuffer();
+
+    PinnedHostBuffer(const PinnedHostBuffer &) = delete;
+
+    PinnedHostBuffer &operator=(const PinnedHostBuffer &) = delete;
+
+    PinnedHostBuffer(PinnedHostBuffer &&other) noexcept;
+
+    PinnedHostBuffer &operator=(PinnedHostBuffer &&other) noexcept;
+
+    /**
+     * Grows the buffer to at least bytes, previous content is discarded.
+     * @throws std::runtime_error if allocation or mapping fails
+     */
+    void reserve(const cl::Context &context, const cl::CommandQueue &queue, size_t bytes);
+
+    [[nodiscard]] uchar *data() const { return static_cast<uchar *>(mapped); }
+    [[nodiscard]] size_t capacity() const { return bytes; }
+
+private:
+    void release();
+
+    cl::Buffer buffer;
+    cl::CommandQueue queue;
+    void *mapped = nullptr;
+    size_t bytes = 0;
+};
+
+/**
+ * OpenCL objects of the OpenCV default context and of the calling thread's
+ * default queue, the queue all cv:: UMat operations are enqueued on.
+ */
+[[nodiscard]] cl::Context oclDefaultContext();
+
+[[nodiscard]] cl::Device oclDefaultDevice();
+
+[[nodiscard]] cl::CommandQueue oclDefaultQueue();
+
+/**
+ * Event that completes once everything enqueued so far on the default queue
+ * did. The queue is flushed so the work starts without a later sync.
+ */
+[[nodiscard]] cl::Event markDefaultQueue();
+
+/**
+ * Makes later work on the default queue wait for event, typically a transfer
+ * on another queue.
+ */
+void waitOnDefaultQueue(const cl::Event &event);
+
+/**
+ * Non-blocking read of a continuous UMat into host memory on queue once all
+ * waitFor events completed. src and dst must stay alive until the returned
+ * event completes.
+ */
+[[nodiscard]] cl::Event enqueueReadUMat(const cl::CommandQueue &queue, const cv::UMat &src, void *dst,
+                                        const std::vector<cl::Event> &waitFor);
+
+/**
+ * Non-blocking write of host memory into a continuous UMat on queue, see
+ * enqueueReadUMat.
+ */
+[[nodiscard]] cl::Event enqueueWriteUMat(const cl::CommandQueue &queue, cv::UMat &dst, const void *src,
+                                         const std::vector<cl::Event> &waitFor);
+
+
+/**
+ * Host view of a UMat mapped for reading. The buffer stays mapped, and the UMat
+ * referenced, until the last owner releases it, so host objects like QImage
+ * can be built directly over data without copying.
+ */
+struct MappedUMat {
+    cv::UMat umat;
+    cl::CommandQueue queue;
+    cl::Buffer buffer;
+    void *data = nullptr;
+    // completes once data is valid
+    cl::Event ready;
+
+    MappedUMat() = default;
+
+    ~MappedUMat();
+
+    MappedUMat(const MappedUMat &) = delete;
+
+    MappedUMat &operator=(const MappedUMat &) = delete;
+};
+
+/**
+ * Non-blocking map of a continuous UMat for reading, once all waitFor events
+ * completed. Zero copy when the UMat was allocated with
+ * USAGE_ALLOCATE_HOST_MEMORY on a device sharing memory with the host.
+ */
+[[nodiscard]] std::shared_ptr<MappedUMat> enqueueMapUMat(const cl::CommandQueue &queue, const cv::UMat &src,
+                                                         const std::vector<cl::Event> &waitFor);
+
+/**
+ * True when the default OpenCL device shares physical memory with the host,
+ * typically CPU and integrated GPU devices.
+ */
+[[nodiscard]] bool oclHostUnifiedMemory();
\ No newline at end of file
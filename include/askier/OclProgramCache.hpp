@@ -0,0 +1,17 @@
+#pragma once
+#include <string>
+#include <opencv2/core/ocl.hpp>
+
+
+/**
+ * Program of one of the embedded kernel sources, built with options.
+ * Compiled binaries are kept in the application data directory under
+ * kernels/, named by a hash of the device name, driver version, options and
+ * source, so later runs load them instead of compiling; a driver update or a
+ * changed source hashes to a new file. Programs already built for the
+ * context in this process are reused. Thread safe.
+ * @param what the kernels, for the error message
+ * @throws std::runtime_error if the source does not compile
+ */
+[[nodiscard]] cv::ocl::Program oclProgram(cv::ocl::Context &context, const std::string &source,
+                                          const std::string &options, const std::string &what);
@@ -0,0 +1,66 @@
+#pragma once
+#include <vector>
+#include <QString>
+
+#include "askier/AsciiPipeline.hpp"
+
+/**
+ * Keeps live conversion within a frame time budget. The requested parameters
+ * form the top of a ladder of operating points; each step down first lowers
+ * the dithering, then falls back to density matching, then turns edges off,
+ * then removes columns. The
+ * controller follows the smoothed busy time of finished frames: it steps
+ * down once a step has settled for QUALITY_DOWNGRADE_FRAMES frames and the
+ * time exceeds the budget, and back up after QUALITY_UPGRADE_FRAMES frames
+ * below QUALITY_UPGRADE_HEADROOM of it, so it does not oscillate between two
+ * points.
+ */
+class QualityController {
+public:
+    /**
+     * @param targetMs frame time budget, 0 disables the controller
+     */
+    explicit QualityController(double targetMs = 0.0);
+
+    void setTarget(double targetMs);
+
+    [[nodiscard]] double target() const { return targetMs; }
+
+    [[nodiscard]] bool enabled() const { return targetMs > 0.0; }
+
+    /**
+     * Parameters of the current operating point for the requested ones, the
+     * requested ones themselves while disabled. Changed requests restart from
+     * the top of the new ladder.
+     */
+    [[nodiscard]] AsciiParams apply(const AsciiParams &requested);
+
+    /**
+     * Feeds back the timings of a finished frame.
+     */
+    void record(const AsciiPipeline::Timings &timings);
+
+    /**
+     * 0 is the requested quality, higher levels are cheaper
+     */
+    [[nodiscard]] int level() const { return currentLevel; }
+
+    [[nodiscard]] double averageMs() const { return smoothedMs; }
+
+    /**
+     * Human readable operating point, e.g. "384 columns, no dithering, no edges"
+     */
+    [[nodiscard]] QString describe() const;
+
+private:
+    void rebuildLadder(const AsciiParams &requested);
+
+    void step(int delta);
+
+    double targetMs;
+    std::vector<AsciiParams> ladder;
+    int currentLevel = 0;
+    int framesSinceChange = 0;
+    // exponential moving average, negative until the first frame after a change
+    double smoothedMs = -1.0;
+};
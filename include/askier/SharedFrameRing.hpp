@@ -0,0 +1,182 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <QImage>
+
+#include "askier/Constants.hpp"
+#include "askier/GlyphGrid.hpp"
+#include "askier/GlyphSet.hpp"
+
+
+/**
+ * Frame of a shared memory ring, in place in the mapping. Rows are contiguous.
+ */
+struct SharedFrameView {
+    // published frames count from 1
+    uint64_t sequence = 0;
+    int64_t timestampUs = 0;
+    int columns = 0, rows = 0;
+    GlyphSet glyphSet = GlyphSet::Ascii;
+    // columns * rows glyph codes
+    const uint8_t *glyphs = nullptr;
+    // BGR per cell, null if the frame has no colors
+    const uint8_t *colors = nullptr;
+    // null if the frame has no preview
+    const uint8_t *preview = nullptr;
+    int previewWidth = 0, previewHeight = 0;
+    // 1 for grayscale, 3 for BGR
+    int previewChannels = 0;
+};
+
+/**
+ * Memory layout shared by SharedFrameWriter and SharedFrameReader:
+ *
+ *   header  "ASKS", u16 version, u16 slot count, u64 payload bytes per slot,
+ *           u32 process id of the writer, u64 sequence of the newest complete
+ *           frame (0 before the first)
+ *   slots   per slot: u64 slot sequence, frame metadata, payload of glyphs,
+ *           colors and preview
+ *
+ * Frame n goes to slot n % slot count. Each slot is a seqlock: the writer
+ * makes its sequence odd, writes the frame and then sets it to 2n. A reader
+ * checks the sequence before and after using the frame in place and discards
+ * what it read when the two differ. Readers never block the writer and need
+ * neither copies nor syscalls; with several slots a reader has
+ * (slot count - 1) frame periods to finish before its slot is reused.
+ */
+namespace shared_frame_ring {
+    constexpr char MAGIC[4] = {'A', 'S', 'K', 'S'};
+    constexpr uint16_t VERSION = 2;
+    constexpr uint8_t HAS_COLORS = 1;
+    constexpr uint8_t HAS_PREVIEW = 2;
+
+    struct Header {
+        char magic[4];
+        uint16_t version;
+        uint16_t slotCount;
+        uint64_t slotBytes;
+        uint32_t writerPid;
+        alignas(64) std::atomic<uint64_t> latest;
+    };
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> sequence;
+        int64_t timestampUs;
+        uint16_t columns, rows;
+        uint8_t glyphSet, flags, previewChannels, reserved;
+        uint32_t previewWidth, previewHeight;
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "the sequences are shared between processes");
+
+    constexpr size_t alignUp(const size_t bytes) { return (bytes + 63) & ~static_cast<size_t>(63); }
+
+    constexpr size_t slotStride(const uint64_t slotBytes) { return alignUp(sizeof(Slot) + slotBytes); }
+
+    constexpr size_t mappingBytes(const uint16_t slotCount, const uint64_t slotBytes) {
+        return alignUp(sizeof(Header)) + slotCount * slotStride(slotBytes);
+    }
+}
+
+/**
+ * Publishes frames into a POSIX shared memory ring other local processes
+ * attach to with SharedFrameReader, see shared_frame_ring. The writer owns
+ * the shared memory object and unlinks it on destruction. Single writer.
+ * Only supported on Linux, elsewhere the constructor throws.
+ */
+class SharedFrameWriter {
+public:
+    /**
+     * @param name shared memory object name, starting with '/'
+     * @param slotBytes payload capacity of a slot, glyphs + colors + preview
+     * @throws std::runtime_error if the shared memory cannot be created, or the
+     *         name is taken by a live writer; a ring whose writer exited without
+     *         removing it is replaced
+     */
+    SharedFrameWriter(const std::string &name, uint64_t slotBytes, int slotCount = SHARED_FRAME_SLOTS);
+
+    ~SharedFrameWriter();
+
+    SharedFrameWriter(const SharedFrameWriter &) = delete;
+
+    SharedFrameWriter &operator=(const SharedFrameWriter &) = delete;
+
+    /**
+     * Copies the frame into the next slot and publishes it.
+     * @param colors null or a BGR888 image of the grid's size, see AsciiPipeline::Result::colors
+     * @param preview null, or a Grayscale8 or BGR888 image
+     * @return false if the frame exceeds the slot capacity, nothing is published then
+     */
+    bool publish(const GlyphGrid &glyphs, int64_t timestampUs, const QImage &colors = {},
+                 const QImage &preview = {});
+
+    [[nodiscard]] uint64_t published() const { return sequence; }
+
+    [[nodiscard]] const std::string &name() const { return name_; }
+
+private:
+    std::string name_;
+    void *mapping = nullptr;
+    size_t mappingBytes = 0;
+    uint64_t sequence = 0;
+};
+
+/**
+ * Attaches read-only to the ring of a SharedFrameWriter, any number of
+ * readers may attach.
+ */
+class SharedFrameReader {
+public:
+    /**
+     * @throws std::runtime_error if the object does not exist or is no frame ring
+     */
+    explicit SharedFrameReader(const std::string &name);
+
+    ~SharedFrameReader();
+
+    SharedFrameReader(const SharedFrameReader &) = delete;
+
+    SharedFrameReader &operator=(const SharedFrameReader &) = delete;
+
+    /**
+     * Sequence of the newest complete frame, 0 before the first
+     */
+    [[nodiscard]] uint64_t latest() const;
+
+    /**
+     * Calls use with the newest frame in place. When the writer reused the
+     * slot meanwhile, whatever use derived from the frame is torn and must be
+     * discarded.
+     * @return false if there was no frame or it was overwritten during use
+     */
+    template<typename Use>
+    bool readLatest(Use &&use) const {
+        for (int attempt = 0; attempt < SHARED_FRAME_READ_ATTEMPTS; ++attempt) {
+            const uint64_t frame = latest();
+            if (frame == 0) {
+                return false;
+            }
+            const auto *slot = slotOf(frame);
+            const uint64_t begin = slot->sequence.load(std::memory_order_acquire);
+            if (begin != 2 * frame) {
+                // already being reused, a newer frame is complete
+                continue;
+            }
+            use(view(*slot, frame));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return slot->sequence.load(std::memory_order_relaxed) == begin;
+        }
+        return false;
+    }
+
+private:
+    [[nodiscard]] const shared_frame_ring::Slot *slotOf(uint64_t frame) const;
+
+    [[nodiscard]] SharedFrameView view(const shared_frame_ring::Slot &slot, uint64_t frame) const;
+
+    const void *mapping = nullptr;
+    size_t mappingBytes = 0;
+    const shared_frame_ring::Header *header = nullptr;
+};
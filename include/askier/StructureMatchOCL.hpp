@@ -0,0 +1,38 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/ocl.hpp>
+#include <array>
+
+#include "askier/GlyphDensityCalibrator.hpp"
+
+
+/**
+ * Shape features of the calibrated glyphs: the mean luminance of each glyph
+ * pixmap over a STRUCTURE_BLOCKS x STRUCTURE_BLOCKS grid of sub-blocks, in
+ * [0, 1] with 1 for paper.
+ * @return ASCII_COUNT rows of STRUCTURE_FEATURES values in glyph code order, CV_32F
+ */
+[[nodiscard]] cv::Mat glyph_structure_features(const GlyphDensityCalibrator &calibrator);
+
+/**
+ * Enqueues structure aware glyph matching. src holds STRUCTURE_BLOCKS x
+ * STRUCTURE_BLOCKS luminance sub-blocks per cell, each cell gets the glyph
+ * whose features are nearest to its sub-blocks in the least squares sense, so
+ * glyphs follow the lines inside a cell instead of only its mean darkness.
+ * The work-group stages the glyph features in local memory.
+ * @param src sub-block luminance, STRUCTURE_BLOCKS times the cell grid in both dimensions
+ * @param deviceFeatures features from glyph_structure_features
+ * @param usage allocation of the returned glyph grid
+ * @param localSize work-group size, {0, 0} leaves it to the driver
+ */
+[[nodiscard]] cv::UMat ascii_match_structure_ocl(cv::ocl::Context &context, const cv::UMat &src,
+                                                 const cv::UMat &deviceFeatures,
+                                                 cv::UMatUsageFlags usage = cv::USAGE_ALLOCATE_DEVICE_MEMORY,
+                                                 const std::array<size_t, 2> &localSize = {0, 0});
+
+/**
+ * Host implementation of ascii_match_structure_ocl on 128-bit SIMD registers,
+ * parallel over the cell rows.
+ */
+void ascii_match_structure_cpu(const cv::Mat &src, const cv::Mat &features, cv::Mat &glyphs);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/ocl.hpp>
+#include <array>
+
+#include "askier/GlyphSet.hpp"
+
+
+/**
+ * Enqueues thresholding of sub-cell luminance into the bit pattern codes of a
+ * braille or block glyph set, one work-item per cell. Sub-cells darker than
+ * SUBCELL_INK_THRESHOLD are inked, dithering the sub-cells beforehand turns
+ * gray levels into dot density.
+ * @param src sub-cell luminance, glyphSetLayout(set) times the cell grid
+ * @param usage allocation of the returned glyph grid
+ * @param localSize work-group size, {0, 0} leaves it to the driver
+ */
+[[nodiscard]] cv::UMat ascii_pack_subcells_ocl(cv::ocl::Context &context, const cv::UMat &src, GlyphSet set,
+                                               cv::UMatUsageFlags usage = cv::USAGE_ALLOCATE_DEVICE_MEMORY,
+                                               const std::array<size_t, 2> &localSize = {0, 0});
@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "askier/AsciiRecording.hpp"
+
+/**
+ * Plays a recording on an ANSI terminal. Frames are decoded ahead on a worker
+ * thread, each frame is written as the cursor moves and glyphs of the cells
+ * that changed since the last frame shown, with one write call per frame.
+ */
+class TerminalPlayer {
+public:
+    struct Stats {
+        size_t framesShown = 0;
+        // late frames skipped to keep the original timing
+        size_t framesDropped = 0;
+        uint64_t bytesWritten = 0;
+        double seconds = 0.0;
+
+        [[nodiscard]] double fps() const { return seconds > 0.0 ? static_cast<double>(framesShown) / seconds : 0.0; }
+    };
+
+    /**
+     * The reader must not be used by anyone else during play.
+     */
+    explicit TerminalPlayer(AsciiRecordingReader &reader, int fd);
+
+    /**
+     * Plays the whole recording at its original timing, or as fast as the
+     * terminal takes it. Returns early once cancelled is set.
+     * @throws std::runtime_error if a frame is corrupt or the terminal write fails
+     */
+    Stats play(bool realtime, const std::atomic<bool> &cancelled);
+
+private:
+    void decodeAhead();
+
+    void stopDecoder();
+
+    void compose(const AsciiFrame &frame);
+
+    void flush();
+
+    AsciiRecordingReader &reader;
+    int fd;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<AsciiFrame> decoded;
+    bool decoderDone = false;
+    bool stopping = false;
+    std::exception_ptr decodeError;
+
+    // what the terminal currently shows
+    int screenColumns = 0, screenRows = 0;
+    bool screenHasColor = false;
+    std::vector<uint8_t> screenGlyphs, screenColors;
+    // packed RGB of the foreground, -1 if unknown
+    int64_t foreground = -1;
+    std::string out;
+    Stats stats;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/ocl.hpp>
+#include <string>
+
+
+/**
+ * Adaptive remapping of cell luminance before the LUT lookup
+ */
+enum class ToneRemap {
+    // luminance maps linearly onto the LUT
+    None,
+    // histogram equalization of the cell grid
+    Equalize,
+    // stretches the TONE_REMAP_PERCENTILE to 1 - TONE_REMAP_PERCENTILE range to [0, 1]
+    Stretch,
+};
+
+/**
+ * Luminance histogram and remap resident on the device across frames.
+ */
+struct ToneRemapState {
+    // TONE_REMAP_BINS bin counts of the current frame, CV_32S
+    cv::UMat histogram;
+    // applied luminance at each of the TONE_REMAP_BINS bin centres, CV_32F
+    cv::UMat remap;
+    // the next frame initializes the remap instead of smoothing towards it
+    bool reset = true;
+};
+
+/**
+ * Enqueues the update of state.remap from the luminance of cells without any
+ * host round trip: a local memory atomics kernel builds the histogram of the
+ * grid and a single work-item derives the remap of the given mode from its
+ * cumulative distribution, smoothed with TONE_REMAP_SMOOTHING across frames.
+ * @param cells cell luminance in [0, 1], CV_32F
+ */
+void tone_remap_update_ocl(cv::ocl::Context &context, const cv::UMat &cells, ToneRemap mode,
+                           ToneRemapState &state);
+
+/**
+ * Program options of kernels reading a remap, they define TONE_REMAP and
+ * TONE_REMAP_BINS.
+ */
+[[nodiscard]] std::string tone_remap_build_options();
@@ -13,6 +13,14 @@ public:
 
     void stop();
 
+    /**
+     * Frames are only emitted while the previous one was consumed, so a slow
+     * receiver sees the latest frames instead of a growing backlog.
+     */
+    void markFrameConsumed();
+
+    [[nodiscard]] size_t skippedFrames() const { return skipped_frames; }
+
     signals:
 
 
@@ -26,4 +34,6 @@ protected:
 private:
     int device_index;
     std::atomic<bool> is_running{false};
+    std::atomic<bool> frame_pending{false};
+    std::atomic<size_t> skipped_frames{0};
 };
\ No newline at end of file
@@ -2,10 +2,12 @@
 #include <QDialog>
 #include <QLabel>
 #include <QMenuBar>
+#include <QCheckBox>
 #include <QComboBox>
 #include <QPushButton>
 
 #include "askier/AsciiPipeline.hpp"
+#include "gui/DoubleSlider.hpp"
 
 class ConversionParamsDialog : public QDialog {
     Q_OBJECT
@@ -22,10 +24,32 @@ public
 
     void onDitheringChanged(const QString &text);
 
+signals:
+    /**
+     * Emitted on every change of a control, while a slider is dragged too,
+     * with the parameters getParams would return
+     */
+    void paramsChanged(const AsciiParams &params);
+
 private:
+    /**
+     * Enables the options that only apply to ASCII density matching
+     */
+    void updateDensityOptions();
+
     QLabel *label;
     QComboBox *dithering_combo;
     QSlider *columns_slider;
+    QComboBox *edge_combo;
+    DoubleSlider *edge_strength_slider;
+    QComboBox *normalization_combo;
+    QComboBox *glyph_set_combo;
+    QComboBox *matching_combo;
+    QComboBox *tone_combo;
+    QCheckBox *hysteresis_checkbox;
+    QCheckBox *color_checkbox;
+    QPushButton *background_button;
+    QCheckBox *adaptive_checkbox;
     QPushButton *apply_button, *cancel_button;
     AsciiParams params;
 };
\ No newline at end of file
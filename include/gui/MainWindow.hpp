@@ -1,10 +1,17 @@
 #pragma once
+#include <chrono>
+#include <cstdint>
+#include <optional>
 #include <QMainWindow>
 #include <opencv2/core/mat.hpp>
 #include <QLabel>
+#include <QTimer>
 
 #include "askier/AsciiPipeline.hpp"
+#include "askier/AsciiRecording.hpp"
 #include "askier/GlyphDensityCalibrator.hpp"
+#include "askier/GlyphEngineCache.hpp"
+#include "askier/QualityController.hpp"
 #include "askier/VideoCaptureWorker.hpp"
 
 
@@ -33,6 +40,8 @@ private
 
     void onSaveAscii();
 
+    void onToggleRecording(bool checked);
+
     void onFrameCaptured(const cv::Mat &frame);
 
     void refreshAsciiFromStill();
@@ -41,6 +50,12 @@ private
 
     void onAdjustParams();
 
+    void onLiveParamsChanged(const AsciiParams &changed);
+
+    void onLivePreviewTimeout();
+
+    void onFrameBudgetChanged(QAction *action);
+
 private:
     void setupUi();
 
@@ -48,10 +63,24 @@ private:
 
     void stopCamera();
 
-    void ensureCalibrator();
+    void switchGlyphEngine();
+
+    [[nodiscard]] double cellAspect() const;
+
+    bool loadStill();
 
     void runAsciiPipeline(const cv::Mat &bgr);
 
+    /**
+     * Converts the still at full resolution with passParams on stillPipeline,
+     * off the ui thread. One pass runs at a time, a pass requested meanwhile
+     * follows it. Results of passes superseded by a later still, font or
+     * parameter change are dropped.
+     */
+    void startStillPass(const AsciiParams &passParams);
+
+    void showStillResult(const AsciiPipeline::Result &result);
+
     // ui
     QLabel *originalView = nullptr;
     QLabel *middleView = nullptr;
@@ -59,19 +88,42 @@ private:
     QAction *actToggleMode = nullptr;
     QAction *actOpenImage = nullptr;
     QAction *actSaveAscii = nullptr;
+    QAction *actRecordAscii = nullptr;
     QAction *actChooseFont = nullptr;
     QAction *actAdjustParams = nullptr;
+    QAction *actSkipStatic = nullptr;
     // state
     InputMode mode = InputMode::Camera;
     QImage lastOriginalImage;
-    std::vector<QString> lastAsciiLines;
+    GlyphGrid lastAsciiGlyphs;
 
     // Engine
     std::unique_ptr<VideoCaptureWorker> captureWorker;
-    std::shared_ptr<GlyphDensityCalibrator> calibrator;
+    GlyphEngineCache engines;
     std::unique_ptr<AsciiPipeline> pipeline;
     AsciiParams params;
+    // steps params down to hold the frame budget in camera mode
+    QualityController quality;
+    std::unique_ptr<AsciiRecordingWriter> recorder;
+    std::chrono::steady_clock::time_point recordingStart;
 
     // Cache for still image processing
+    QString stillPath;
     cv::Mat stillBgr;
+    int stillDecodeFactor = 1;
+    // oriented size stillDecodeFactor was chosen for
+    cv::Size stillSourceSize;
+
+    // Live preview while the parameters dialog is open
+    QTimer *livePreviewTimer = nullptr;
+    QTimer *liveSettleTimer = nullptr;
+    AsciiParams liveParams;
+    // downscaled still the live preview converts, see LIVE_PREVIEW_PROXY_SCALE
+    cv::Mat proxyBgr;
+    // full resolution passes, its own pipeline so proxies convert while a pass runs
+    std::unique_ptr<AsciiPipeline> stillPipeline;
+    // bumped by every change a pass in flight is stale after
+    uint64_t stillGeneration = 0;
+    std::optional<uint64_t> runningPassGeneration;
+    std::optional<AsciiParams> pendingPassParams;
 };
\ No newline at end of file
@@ -5,6 +5,9 @@
 #include <opencv2/core/mat.hpp>
 #include <opencv2/core/ocl.hpp>
 
+#include "askier/ASCIIDrawGlyphsOCL.hpp"
+#include "askier/OclProgramCache.hpp"
+
 
 static std::string kernel_source = R"SRC(
 kernel void ascii_map_glyphs(
@@ -15,7 +18,8 @@ kernel void ascii_map_glyphs(
     int pixmap_height,
     int glyphs_cols,
     int glyphs_rows,
-    int dst_cols
+    int dst_cols,
+    int first_code
 ) {
      const size_t x = get_global_id(0);
      const size_t y = get_global_id(1);
@@ -24,7 +28,7 @@ kernel void ascii_map_glyphs(
     }
     const size_t glyph_idx = y * glyphs_cols + x;
     uchar glyph = glyphs[glyph_idx];
-    int pixmap_glyph_idx = glyph - 32;
+    int pixmap_glyph_idx = glyph - first_code;
     const int glyph_area = pixmap_height * pixmap_width;
     const int pixmap_start_offset = pixmap_glyph_idx * glyph_area;
     const int dst_pixel_y = y * pixmap_height;
@@ -39,16 +43,248 @@ kernel void ascii_map_glyphs(
         }
     }
 }
+
+kernel void ascii_map_glyphs_vec(
+    __global const uchar *glyphs,
+    __global const uchar *dense_pixmaps,
+    __global uchar *dst,
+    int pixmap_width,
+    int pixmap_height,
+    int glyphs_cols,
+    int glyphs_rows,
+    int dst_cols,
+    int first_code
+) {
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= glyphs_cols || y >= glyphs_rows) {
+        return;
+    }
+    const int pixmap_glyph_idx = glyphs[y * glyphs_cols + x] - first_code;
+    __global const uchar *pixmap = dense_pixmaps + pixmap_glyph_idx * pixmap_height * pixmap_width;
+    __global uchar *cell = dst + (y * pixmap_height) * dst_cols + x * pixmap_width;
+    const int vector_end = pixmap_width & ~7;
+    for(int pmap_y = 0; pmap_y < pixmap_height; ++pmap_y) {
+        __global const uchar *src_row = pixmap + pmap_y * pixmap_width;
+        __global uchar *dst_row = cell + pmap_y * dst_cols;
+        int pmap_x = 0;
+        for(; pmap_x < vector_end; pmap_x += 8) {
+            vstore8(vload8(0, src_row + pmap_x), 0, dst_row + pmap_x);
+        }
+        for(; pmap_x < pixmap_width; ++pmap_x) {
+            dst_row[pmap_x] = src_row[pmap_x];
+        }
+    }
+}
+
+kernel void ascii_map_glyphs_pixel(
+    __global const uchar *glyphs,
+    __global const uchar *dense_pixmaps,
+    __global uchar *dst,
+    int pixmap_width,
+    int pixmap_height,
+    int glyphs_cols,
+    int glyphs_rows,
+    int dst_cols,
+    int first_code
+) {
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= glyphs_cols * pixmap_width || y >= glyphs_rows * pixmap_height) {
+        return;
+    }
+    const int cell_x = x / pixmap_width;
+    const int cell_y = y / pixmap_height;
+    const int pixmap_glyph_idx = glyphs[cell_y * glyphs_cols + cell_x] - first_code;
+    const int pmap_x = x - cell_x * pixmap_width;
+    const int pmap_y = y - cell_y * pixmap_height;
+    dst[y * dst_cols + x] =
+        dense_pixmaps[(pixmap_glyph_idx * pixmap_height + pmap_y) * pixmap_width + pmap_x];
+}
+
+kernel void ascii_map_glyphs_pixel_local(
+    __global const uchar *glyphs,
+    __global const uchar *dense_pixmaps,
+    __global uchar *dst,
+    int pixmap_width,
+    int pixmap_height,
+    int glyphs_cols,
+    int glyphs_rows,
+    int dst_cols,
+    int first_code,
+    __local uchar *atlas,
+    int atlas_size
+) {
+    // the whole work-group stages the atlas before any early return
+    const int local_idx = get_local_id(1) * get_local_size(0) + get_local_id(0);
+    const int local_count = get_local_size(0) * get_local_size(1);
+    for(int i = local_idx; i < atlas_size; i += local_count) {
+        atlas[i] = dense_pixmaps[i];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= glyphs_cols * pixmap_width || y >= glyphs_rows * pixmap_height) {
+        return;
+    }
+    const int cell_x = x / pixmap_width;
+    const int cell_y = y / pixmap_height;
+    const int pixmap_glyph_idx = glyphs[cell_y * glyphs_cols + cell_x] - first_code;
+    const int pmap_x = x - cell_x * pixmap_width;
+    const int pmap_y = y - cell_y * pixmap_height;
+    dst[y * dst_cols + x] = atlas[(pixmap_glyph_idx * pixmap_height + pmap_y) * pixmap_width + pmap_x];
+}
+
+// pixmaps hold white paper and black ink, ink takes the cell color
+inline void write_tinted(__global uchar *dst, const int dst_idx, const uint paper,
+                         __global const uchar *color, const uint background) {
+    const uint ink = 255 - paper;
+    for(int c = 0; c < 3; ++c) {
+        const uint background_c = (background >> (8 * c)) & 0xff;
+        dst[dst_idx * 3 + c] = (uchar) ((background_c * paper + color[c] * ink + 127) / 255);
+    }
+}
+
+kernel void ascii_map_glyphs_color_pixel(
+    __global const uchar *glyphs,
+    __global const uchar *dense_pixmaps,
+    __global const uchar *colors,
+    __global uchar *dst,
+    int pixmap_width,
+    int pixmap_height,
+    int glyphs_cols,
+    int glyphs_rows,
+    int dst_cols,
+    int first_code,
+    uint background
+) {
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= glyphs_cols * pixmap_width || y >= glyphs_rows * pixmap_height) {
+        return;
+    }
+    const int cell_x = x / pixmap_width;
+    const int cell_y = y / pixmap_height;
+    const int cell_idx = cell_y * glyphs_cols + cell_x;
+    const int pixmap_glyph_idx = glyphs[cell_idx] - first_code;
+    const int pmap_x = x - cell_x * pixmap_width;
+    const int pmap_y = y - cell_y * pixmap_height;
+    write_tinted(dst, y * dst_cols + x,
+                 dense_pixmaps[(pixmap_glyph_idx * pixmap_height + pmap_y) * pixmap_width + pmap_x],
+                 colors + cell_idx * 3, background);
+}
+
+kernel void ascii_map_glyphs_color_pixel_local(
+    __global const uchar *glyphs,
+    __global const uchar *dense_pixmaps,
+    __global const uchar *colors,
+    __global uchar *dst,
+    int pixmap_width,
+    int pixmap_height,
+    int glyphs_cols,
+    int glyphs_rows,
+    int dst_cols,
+    int first_code,
+    uint background,
+    __local uchar *atlas,
+    int atlas_size
+) {
+    // the whole work-group stages the atlas before any early return
+    const int local_idx = get_local_id(1) * get_local_size(0) + get_local_id(0);
+    const int local_count = get_local_size(0) * get_local_size(1);
+    for(int i = local_idx; i < atlas_size; i += local_count) {
+        atlas[i] = dense_pixmaps[i];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= glyphs_cols * pixmap_width || y >= glyphs_rows * pixmap_height) {
+        return;
+    }
+    const int cell_x = x / pixmap_width;
+    const int cell_y = y / pixmap_height;
+    const int cell_idx = cell_y * glyphs_cols + cell_x;
+    const int pixmap_glyph_idx = glyphs[cell_idx] - first_code;
+    const int pmap_x = x - cell_x * pixmap_width;
+    const int pmap_y = y - cell_y * pixmap_height;
+    write_tinted(dst, y * dst_cols + x, atlas[(pixmap_glyph_idx * pixmap_height + pmap_y) * pixmap_width + pmap_x],
+                 colors + cell_idx * 3, background);
+}
+
+// one work-item per output pixel of an adaptive layout, see ascii_adaptive_layout_ocl
+kernel void ascii_map_placements_pixel(
+    __global const uchar4 *cover,
+    __global const uchar *pixmaps1,
+    __global const uchar *pixmaps2,
+    __global const uchar *pixmaps4,
+    __global uchar *dst,
+    int pixmap_width,
+    int pixmap_height,
+    int glyphs_cols,
+    int glyphs_rows,
+    int dst_cols,
+    int first_code
+) {
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= glyphs_cols * pixmap_width || y >= glyphs_rows * pixmap_height) {
+        return;
+    }
+    const int cell_x = x / pixmap_width;
+    const int cell_y = y / pixmap_height;
+    // code, scale and the cell's position within its placement
+    const uchar4 placement = cover[cell_y * glyphs_cols + cell_x];
+    const int scale = placement.y;
+    __global const uchar *layer = scale == 4 ? pixmaps4 : scale == 2 ? pixmaps2 : pixmaps1;
+    const int width = scale * pixmap_width;
+    const int pmap_x = placement.z * pixmap_width + x - cell_x * pixmap_width;
+    const int pmap_y = placement.w * pixmap_height + y - cell_y * pixmap_height;
+    dst[y * dst_cols + x] =
+        layer[((placement.x - first_code) * scale * pixmap_height + pmap_y) * width + pmap_x];
+}
 )SRC";
 
-cv::Mat ascii_draw_glyphs_ocl(
+static const char *kernelName(const GlyphDrawVariant variant) {
+    switch (variant) {
+        case GlyphDrawVariant::PerCellVector:
+            return "ascii_map_glyphs_vec";
+        case GlyphDrawVariant::PerPixel:
+            return "ascii_map_glyphs_pixel";
+        case GlyphDrawVariant::PerPixelLocalAtlas:
+            return "ascii_map_glyphs_pixel_local";
+        case GlyphDrawVariant::PerCell:
+        default:
+            return "ascii_map_glyphs";
+    }
+}
+
+static cv::ocl::Program drawProgram(cv::ocl::Context &context) {
+    return oclProgram(context, kernel_source, "", "ascii draw glyphs");
+}
+
+/**
+ * Variant of config that runs with the given atlas
+ */
+static GlyphDrawVariant drawVariant(const KernelLaunchConfig &config, const cv::UMat &densePixmaps) {
+    // larger atlases of other glyph sets may not fit where the ASCII one was tuned
+    if (config.drawVariant == GlyphDrawVariant::PerPixelLocalAtlas &&
+        densePixmaps.total() > cv::ocl::Device::getDefault().localMemSize()) {
+        return GlyphDrawVariant::PerPixel;
+    }
+    return config.drawVariant;
+}
+
+cv::UMat ascii_draw_glyphs_ocl(
     cv::ocl::Context &context,
     const cv::UMat &glyphs,
     const cv::UMat &densePixmaps,
     const int pixmapWidth,
     const int pixmapHeight,
     const int outputCellWidth,
-    const int outputCellHeight
+    const int outputCellHeight,
+    cv::UMatUsageFlags usage,
+    const KernelLaunchConfig &config,
+    const int firstCode
 ) {
     CV_Assert(glyphs.type() == CV_8U);
     CV_Assert(densePixmaps.type() == CV_8U);
@@ -57,31 +293,136 @@ cv::Mat ascii_draw_glyphs_ocl(
     const int dstCols = glyphs.cols * outputCellWidth;
     const int dstRows = glyphs.rows * outputCellHeight;
 
-    cv::UMat dst(cv::Size(dstCols, dstRows), CV_8UC1,
-                 cv::USAGE_ALLOCATE_DEVICE_MEMORY);
+    cv::UMat dst(cv::Size(dstCols, dstRows), CV_8UC1, usage);
 
-    cv::ocl::ProgramSource source(kernel_source);
-    std::string compileErrors;
-    cv::ocl::Program program = context.getProg(source, "", compileErrors);
-    if (program.empty()) {
-        throw std::runtime_error("OpenCL ascii draw glyphs compilation failed" + compileErrors);
+    const cv::ocl::Program program = drawProgram(context);
+    const GlyphDrawVariant variant = drawVariant(config, densePixmaps);
+    cv::ocl::Kernel kernel(kernelName(variant), program);
+    CV_Assert(!kernel.empty());
+    CV_Assert(densePixmaps.isContinuous());
+    CV_Assert(glyphs.isContinuous());
+    CV_Assert(dst.isContinuous());
+    int argi = 0;
+    kernel.set(argi++, cv::ocl::KernelArg::PtrReadOnly(glyphs));
+    kernel.set(argi++, cv::ocl::KernelArg::PtrReadOnly(densePixmaps));
+    kernel.set(argi++, cv::ocl::KernelArg::PtrWriteOnly(dst));
+    kernel.set(argi++, pixmapWidth);
+    kernel.set(argi++, pixmapHeight);
+    kernel.set(argi++, glyphs.cols);
+    kernel.set(argi++, glyphs.rows);
+    kernel.set(argi++, dst.cols);
+    kernel.set(argi++, firstCode);
+    const bool perPixel = variant == GlyphDrawVariant::PerPixel ||
+                          variant == GlyphDrawVariant::PerPixelLocalAtlas;
+    if (variant == GlyphDrawVariant::PerPixelLocalAtlas) {
+        const size_t atlasSize = densePixmaps.total();
+        kernel.set(argi++, cv::ocl::KernelArg::Local(atlasSize));
+        kernel.set(argi++, static_cast<int>(atlasSize));
     }
-    cv::ocl::Kernel kernel("ascii_map_glyphs", program);
+    bool run_ok = perPixel
+                      ? runKernel2D(kernel, dst.cols, dst.rows, config.drawLocalSize, false)
+                      : runKernel2D(kernel, glyphs.cols, glyphs.rows, config.drawLocalSize, false);
+    CV_Assert(run_ok);
+    return dst;
+}
+
+cv::UMat ascii_draw_glyphs_color_ocl(
+    cv::ocl::Context &context,
+    const cv::UMat &glyphs,
+    const cv::UMat &colors,
+    const cv::UMat &densePixmaps,
+    const int pixmapWidth,
+    const int pixmapHeight,
+    const cv::Vec3b &background,
+    cv::UMatUsageFlags usage,
+    const KernelLaunchConfig &config,
+    const int firstCode
+) {
+    CV_Assert(glyphs.type() == CV_8U);
+    CV_Assert(colors.type() == CV_8UC3);
+    CV_Assert(colors.size() == glyphs.size());
+    CV_Assert(densePixmaps.type() == CV_8U);
+    const int dstCols = glyphs.cols * pixmapWidth;
+    const int dstRows = glyphs.rows * pixmapHeight;
+
+    cv::UMat dst(cv::Size(dstCols, dstRows), CV_8UC3, usage);
+
+    const cv::ocl::Program program = drawProgram(context);
+    // per cell variants write whole pixmap rows, the tinted pixels are written one by one
+    const bool localAtlas = drawVariant(config, densePixmaps) == GlyphDrawVariant::PerPixelLocalAtlas;
+    cv::ocl::Kernel kernel(localAtlas ? "ascii_map_glyphs_color_pixel_local" : "ascii_map_glyphs_color_pixel",
+                           program);
     CV_Assert(!kernel.empty());
     CV_Assert(densePixmaps.isContinuous());
     CV_Assert(glyphs.isContinuous());
+    CV_Assert(colors.isContinuous());
     CV_Assert(dst.isContinuous());
+    const unsigned int packedBackground = background[0] | background[1] << 8 | background[2] << 16;
     int argi = 0;
     kernel.set(argi++, cv::ocl::KernelArg::PtrReadOnly(glyphs));
     kernel.set(argi++, cv::ocl::KernelArg::PtrReadOnly(densePixmaps));
+    kernel.set(argi++, cv::ocl::KernelArg::PtrReadOnly(colors));
     kernel.set(argi++, cv::ocl::KernelArg::PtrWriteOnly(dst));
     kernel.set(argi++, pixmapWidth);
     kernel.set(argi++, pixmapHeight);
     kernel.set(argi++, glyphs.cols);
     kernel.set(argi++, glyphs.rows);
     kernel.set(argi++, dst.cols);
-    size_t globals[2] = {(size_t) glyphs.cols, (size_t) glyphs.rows};
-    bool run_ok = kernel.run(2, globals, nullptr, true);
+    kernel.set(argi++, firstCode);
+    kernel.set(argi++, packedBackground);
+    if (localAtlas) {
+        const size_t atlasSize = densePixmaps.total();
+        kernel.set(argi++, cv::ocl::KernelArg::Local(atlasSize));
+        kernel.set(argi++, static_cast<int>(atlasSize));
+    }
+    // enqueue only, consumers are ordered after it on the same queue
+    bool run_ok = runKernel2D(kernel, dst.cols, dst.rows, config.drawLocalSize, false);
+    CV_Assert(run_ok);
+    return dst;
+}
+
+cv::UMat ascii_draw_placements_ocl(
+    cv::ocl::Context &context,
+    const cv::UMat &cover,
+    const cv::UMat &densePixmaps,
+    const cv::UMat &pixmaps2,
+    const cv::UMat &pixmaps4,
+    const int pixmapWidth,
+    const int pixmapHeight,
+    cv::UMatUsageFlags usage,
+    const KernelLaunchConfig &config,
+    const int firstCode
+) {
+    CV_Assert(cover.type() == CV_8UC4);
+    CV_Assert(densePixmaps.type() == CV_8U && pixmaps2.type() == CV_8U && pixmaps4.type() == CV_8U);
+    CV_Assert(pixmaps2.total() == 4 * densePixmaps.total());
+    CV_Assert(pixmaps4.total() == 16 * densePixmaps.total());
+    CV_Assert(cover.isContinuous());
+    const int dstCols = cover.cols * pixmapWidth;
+    const int dstRows = cover.rows * pixmapHeight;
+
+    cv::UMat dst(cv::Size(dstCols, dstRows), CV_8UC1, usage);
+
+    const cv::ocl::Program program = drawProgram(context);
+    // pixels of coarse glyphs differ in their pixmap, the per cell variants do not apply
+    cv::ocl::Kernel kernel("ascii_map_placements_pixel", program);
+    CV_Assert(!kernel.empty());
+    CV_Assert(dst.isContinuous());
+    kernel.args(
+        cv::ocl::KernelArg::PtrReadOnly(cover),
+        cv::ocl::KernelArg::PtrReadOnly(densePixmaps),
+        cv::ocl::KernelArg::PtrReadOnly(pixmaps2),
+        cv::ocl::KernelArg::PtrReadOnly(pixmaps4),
+        cv::ocl::KernelArg::PtrWriteOnly(dst),
+        pixmapWidth,
+        pixmapHeight,
+        cover.cols,
+        cover.rows,
+        dst.cols,
+        firstCode
+    );
+    // enqueue only, consumers are ordered after it on the same queue
+    bool run_ok = runKernel2D(kernel, dst.cols, dst.rows, config.drawLocalSize, false);
     CV_Assert(run_ok);
-    return dst.getMat(cv::ACCESS_READ).clone();
+    return dst;
 }
@@ -0,0 +1,184 @@
+#include "askier/AdaptiveLayoutOCL.hpp"
+#include <askier/KernelAutotuner.hpp>
+#include <askier/OclProgramCache.hpp>
+#include <askier/ToneRemapOCL.hpp>
+
+#include <stdexcept>
+#include <string>
+
+
+static std::string kernel_source = R"SRC(
+#ifdef TONE_REMAP
+inline float remapped(__global const float *remap, const float luminance) {
+    const float position = clamp(luminance, 0.0f, 1.0f) * (TONE_REMAP_BINS - 1);
+    const int bin = min((int) position, TONE_REMAP_BINS - 2);
+    return mix(remap[bin], remap[bin + 1], position - (float) bin);
+}
+#define REMAP(luminance) remapped(remap, luminance)
+#else
+#define REMAP(luminance) (luminance)
+#endif
+
+inline uchar lut_glyph(__global const uchar *lut, const float luminance) {
+    const int index = (int) round((1.0f - luminance) * (LUT_SIZE - 1));
+    return lut[clamp(index, 0, LUT_SIZE - 1)];
+}
+
+// records a placement, the offset of each cell it covers within it and the cells' glyph on the uniform grid
+inline ushort4 place(
+    __global uchar4 *cover,
+    __global uchar *glyphs,
+    const int cols,
+    const int x,
+    const int y,
+    const int code,
+    const int scale,
+    const uchar cell_code
+) {
+    for (int dy = 0; dy < scale; ++dy) {
+        for (int dx = 0; dx < scale; ++dx) {
+            const int idx = (y + dy) * cols + x + dx;
+            cover[idx] = (uchar4) ((uchar) code, (uchar) scale, (uchar) dx, (uchar) dy);
+            glyphs[idx] = cell_code;
+        }
+    }
+    return (ushort4) ((ushort) x, (ushort) y, (ushort) code, (ushort) scale);
+}
+
+// whether size x size cells from x, y are flat, and their mean luminance
+inline bool flat_block(
+    __global const float *cells,
+    __global const float *mean_squares,
+    const int cols,
+    const int x,
+    const int y,
+    const int size,
+    const float flatness,
+    float *mean
+) {
+    float low = 1.0f, high = 0.0f, sum = 0.0f, variance = 0.0f;
+    for (int dy = 0; dy < size; ++dy) {
+        for (int dx = 0; dx < size; ++dx) {
+            const int idx = (y + dy) * cols + x + dx;
+            const float luminance = cells[idx];
+            low = fmin(low, luminance);
+            high = fmax(high, luminance);
+            sum += luminance;
+            variance = fmax(variance, mean_squares[idx] - luminance * luminance);
+        }
+    }
+    *mean = sum / (float) (size * size);
+    return high - low <= flatness && variance <= flatness * flatness;
+}
+
+kernel void adaptive_layout(
+__global const float *cells,
+__global const float *dithered,
+__global const float *mean_squares,
+__global const uchar *lut1,
+__global const uchar *lut2,
+__global const uchar *lut4,
+__global ushort4 *placements,
+__global uchar4 *cover,
+__global uchar *glyphs,
+int cols,
+int rows,
+float flatness
+#ifdef TONE_REMAP
+, __global const float *remap
+#endif
+)
+{
+    const int block_x = get_global_id(0);
+    const int block_y = get_global_id(1);
+    const int block_cols = (cols + 3) / 4;
+    if (block_x >= block_cols || block_y * 4 >= rows) {
+        return;
+    }
+    __global ushort4 *block = placements + (block_y * block_cols + block_x) * 16;
+    const int x = block_x * 4;
+    const int y = block_y * 4;
+    int count = 0;
+    float mean;
+    if (x + 4 <= cols && y + 4 <= rows && flat_block(cells, mean_squares, cols, x, y, 4, flatness, &mean)) {
+        const float luminance = REMAP(mean);
+        block[count++] = place(cover, glyphs, cols, x, y, lut_glyph(lut4, luminance), 4, lut_glyph(lut1, luminance));
+    } else {
+        for (int quadrant = 0; quadrant < 4; ++quadrant) {
+            const int quadrant_x = x + (quadrant & 1) * 2;
+            const int quadrant_y = y + (quadrant >> 1) * 2;
+            if (quadrant_x + 2 <= cols && quadrant_y + 2 <= rows &&
+                flat_block(cells, mean_squares, cols, quadrant_x, quadrant_y, 2, flatness, &mean)) {
+                const float luminance = REMAP(mean);
+                block[count++] = place(cover, glyphs, cols, quadrant_x, quadrant_y, lut_glyph(lut2, luminance), 2,
+                                       lut_glyph(lut1, luminance));
+                continue;
+            }
+            for (int cell = 0; cell < 4; ++cell) {
+                const int cell_x = quadrant_x + (cell & 1);
+                const int cell_y = quadrant_y + (cell >> 1);
+                if (cell_x < cols && cell_y < rows) {
+                    // only cells that keep their own glyph are mapped
+                    const uchar code = lut_glyph(lut1, REMAP(dithered[cell_y * cols + cell_x]));
+                    block[count++] = place(cover, glyphs, cols, cell_x, cell_y, code, 1, code);
+                }
+            }
+        }
+    }
+    for (; count < 16; ++count) {
+        block[count] = (ushort4) (0);
+    }
+}
+)SRC";
+
+AdaptiveLayout ascii_adaptive_layout_ocl(cv::ocl::Context &context, const cv::UMat &cells, const cv::UMat &dithered,
+                                         const cv::UMat &meanSquares, const cv::UMat &lut1, const cv::UMat &lut2,
+                                         const cv::UMat &lut4, const float flatness,
+                                         const cv::UMatUsageFlags usage, const cv::UMat &remap) {
+    static_assert(ADAPTIVE_CELL_MAX_SCALE == 4, "the kernel works on blocks of 4x4 cells");
+    CV_Assert(cells.type() == CV_32F);
+    CV_Assert(meanSquares.type() == CV_32F && meanSquares.size() == cells.size());
+    CV_Assert(dithered.type() == CV_32F && dithered.size() == cells.size());
+    CV_Assert(lut1.type() == CV_8U && lut1.total() == static_cast<size_t>(ASCII_COUNT));
+    CV_Assert(lut2.type() == CV_8U && lut2.total() == static_cast<size_t>(ASCII_COUNT));
+    CV_Assert(lut4.type() == CV_8U && lut4.total() == static_cast<size_t>(ASCII_COUNT));
+    CV_Assert(cells.cols <= UINT16_MAX && cells.rows <= UINT16_MAX);
+    CV_Assert(cells.isContinuous() && dithered.isContinuous() && meanSquares.isContinuous());
+    const int blockCols = (cells.cols + 3) / 4;
+    const int blockRows = (cells.rows + 3) / 4;
+    AdaptiveLayout layout{
+        cv::UMat(blockCols * blockRows, 16, CV_16UC4, usage),
+        cv::UMat(cells.size(), CV_8UC4, usage),
+        cv::UMat(cells.size(), CV_8U, usage),
+    };
+
+    const bool remapped = !remap.empty();
+    std::string options = "-D LUT_SIZE=" + std::to_string(ASCII_COUNT);
+    if (remapped) {
+        options += " " + tone_remap_build_options();
+    }
+    const cv::ocl::Program program = oclProgram(context, kernel_source, options, "adaptive layout");
+    cv::ocl::Kernel kernel("adaptive_layout", program);
+    CV_Assert(!kernel.empty());
+    kernel.args(
+        cv::ocl::KernelArg::PtrReadOnly(cells),
+        cv::ocl::KernelArg::PtrReadOnly(dithered),
+        cv::ocl::KernelArg::PtrReadOnly(meanSquares),
+        cv::ocl::KernelArg::PtrReadOnly(lut1),
+        cv::ocl::KernelArg::PtrReadOnly(lut2),
+        cv::ocl::KernelArg::PtrReadOnly(lut4),
+        cv::ocl::KernelArg::PtrWriteOnly(layout.placements),
+        cv::ocl::KernelArg::PtrWriteOnly(layout.cover),
+        cv::ocl::KernelArg::PtrWriteOnly(layout.glyphs),
+        cells.cols,
+        cells.rows,
+        flatness
+    );
+    if (remapped) {
+        CV_Assert(remap.type() == CV_32F && remap.total() == static_cast<size_t>(TONE_REMAP_BINS));
+        kernel.set(12, cv::ocl::KernelArg::PtrReadOnly(remap));
+    }
+    // enqueue only, consumers are ordered after it on the same queue
+    CV_Assert(runKernel2D(kernel, blockCols, blockRows, {0, 0}, false));
+    return layout;
+}
@@ -1,7 +1,11 @@
 #include "askier/AsciiPipeline.hpp"
 
-#include <future>
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <limits>
 
 #include <opencv2/core/ocl.hpp>
 #include <opencv2/imgproc.hpp>
@@ -9,123 +13,1135 @@
 #include <stdexcept>
 
 #include "askier/ASCIIDrawGlyphsOCL.hpp"
+#include "askier/AdaptiveLayoutOCL.hpp"
 #include "askier/AsciimapOCL.hpp"
+#include "askier/Constants.hpp"
 #include "askier/Dithering.hpp"
+#include "askier/GlyphHysteresisOCL.hpp"
 #include "askier/ImageUtils.hpp"
+#include "askier/KernelAutotuner.hpp"
+#include "askier/OclAsync.hpp"
 
 AsciiPipeline::AsciiPipeline(
-    const std::shared_ptr<GlyphDensityCalibrator> &calibrator)
-    : calibrator(calibrator) {
+    const std::shared_ptr<GlyphDensityCalibrator> &calibrator,
+    const HostExecutorConfig &hostConfig)
+    : AsciiPipeline(GlyphEngine::create(calibrator), hostConfig) {}
+
+AsciiPipeline::AsciiPipeline(const std::shared_ptr<const GlyphEngine> &engine,
+                             const HostExecutorConfig &hostConfig)
+    : AsciiPipeline(engine, std::make_shared<HostExecutor>(hostConfig)) {}
+
+AsciiPipeline::AsciiPipeline(const std::shared_ptr<const GlyphEngine> &engine,
+                             const std::shared_ptr<HostExecutor> &sharedHost)
+    : host(sharedHost) {
+  CV_Assert(host != nullptr);
   std::cout << "Using OpenCL: " << cv::ocl::haveOpenCL() << std::endl;
   std::cout << "Number devices: " << cv::ocl::Context::getDefault().ndevices()
             << std::endl;
   auto device = cv::ocl::Context::getDefault().device(0);
   clContext = cv::ocl::Context::fromDevice(device);
   std::cout << "Using device: " << device.name() << std::endl;
-  const auto &lut = this->calibrator->lut();
-  cv::Mat hostLut(1, static_cast<int>(lut.size()), CV_8UC1);
-  for (size_t i = 0; i < lut.size(); i++) {
-    hostLut.at<uchar>(0, static_cast<int>(i)) = lut[i];
+  // transfers get their own queue so they overlap with kernels of other frames
+  cl_int err = CL_SUCCESS;
+  transferQueue =
+      cl::CommandQueue(oclDefaultContext(), oclDefaultDevice(), 0, &err);
+  if (err != CL_SUCCESS) {
+    throw std::runtime_error("Failed to create transfer queue: " +
+                             std::to_string(err));
+  }
+  slots.resize(ASYNC_PIPELINE_DEPTH);
+  hostUnifiedMemory = oclHostUnifiedMemory();
+  setEngine(engine);
+}
+
+cv::UMatUsageFlags AsciiPipeline::outputUsage() const {
+  // host allocated buffers can be mapped without a copy on unified memory
+  return hostUnifiedMemory ? cv::USAGE_ALLOCATE_HOST_MEMORY
+                           : cv::USAGE_ALLOCATE_DEVICE_MEMORY;
+}
+
+void AsciiPipeline::setEngine(
+    const std::shared_ptr<const GlyphEngine> &engine) {
+  CV_Assert(engine != nullptr);
+  // benchmarked once per device, later engines only re-check local memory
+  launchConfig = KernelAutotuner::tuned(clContext, *engine);
+  this->engine = engine;
+}
+
+static int rowsForColumns(const cv::Size &size, const int columns,
+                          const double aspect) {
+  return std::max(4, static_cast<int>(std::round(
+                         static_cast<double>(size.height) /
+                         static_cast<double>(size.width) * columns / aspect)));
+}
+
+static cv::UMat grayFloat(const cv::UMat &bgr) {
+  // sources decoded straight to grayscale skip the color conversion
+  cv::UMat grayUint = bgr;
+  if (bgr.channels() != 1) {
+    grayUint = cv::UMat(bgr.size(), CV_8UC1, cv::USAGE_ALLOCATE_DEVICE_MEMORY);
+    cv::cvtColor(bgr, grayUint, cv::COLOR_BGR2GRAY);
   }
-  deviceLut = hostLut.getUMat(cv::ACCESS_READ).clone();
-  const auto &pixmaps = this->calibrator->pixmaps();
-  cv::Mat hostDensePixmaps(1, static_cast<int>(pixmaps.size()), CV_8UC1);
-  for (size_t i = 0; i < pixmaps.size(); i++) {
-    hostDensePixmaps.at<uchar>(0, static_cast<int>(i)) = pixmaps[i];
+  cv::UMat gray(grayUint.size(), CV_32F, cv::USAGE_ALLOCATE_DEVICE_MEMORY);
+  grayUint.convertTo(gray, CV_32F, 1 / 255.0);
+  return gray;
+}
+
+/**
+ * Mean BGR over the source area of each cell of a grid of the given size,
+ * grayscale sources give gray colors.
+ */
+static cv::UMat cellColors(cv::InputArray source, const cv::Size &size) {
+  cv::UMat colors(size, source.type(), cv::USAGE_ALLOCATE_DEVICE_MEMORY);
+  cv::resize(source, colors, size, 0, 0, cv::INTER_AREA);
+  if (colors.channels() == 3) {
+    return colors;
   }
-  deviceDensePixmaps = hostDensePixmaps.getUMat(cv::ACCESS_READ).clone();
-  this->pixmapWidth = calibrator->pixmapWidths()[0];
-  this->pixmapHeight = calibrator->pixmapHeights()[0];
-  if (calibrator->pixmapHeights().size() != calibrator->pixmapWidths().size()) {
-    throw std::runtime_error("pixmap dimensions not equal");
+  cv::UMat bgr(size, CV_8UC3, cv::USAGE_ALLOCATE_DEVICE_MEMORY);
+  cv::cvtColor(colors, bgr,
+               colors.channels() == 1 ? cv::COLOR_GRAY2BGR
+                                      : cv::COLOR_BGRA2BGR);
+  return bgr;
+}
+
+static cv::UMat edgeMagnitude(const cv::UMat &gray,
+                              const EdgeOperator edgeOperator) {
+  cv::UMat gradientX, gradientY, magnitude;
+  switch (edgeOperator) {
+  case EdgeOperator::Sobel:
+    cv::Sobel(gray, gradientX, CV_32F, 2, 0, 5);
+    cv::Sobel(gray, gradientY, CV_32F, 0, 2, 5);
+    cv::magnitude(gradientX, gradientY, magnitude);
+    break;
+  case EdgeOperator::Scharr:
+    cv::Scharr(gray, gradientX, CV_32F, 1, 0);
+    cv::Scharr(gray, gradientY, CV_32F, 0, 1);
+    cv::magnitude(gradientX, gradientY, magnitude);
+    break;
+  case EdgeOperator::Laplacian:
+    cv::Laplacian(gray, gradientX, CV_32F, 3);
+    cv::absdiff(gradientX, cv::Scalar::all(0), magnitude);
+    break;
+  case EdgeOperator::None:
+    break;
   }
-  for (size_t i = 0; i < calibrator->pixmapHeights().size(); ++i) {
-    if (calibrator->pixmapHeights()[i] != this->pixmapHeight) {
-      throw std::runtime_error("Inconsistent pixmap heights");
-    }
-    if (calibrator->pixmapWidths()[i] != this->pixmapWidth) {
-      throw std::runtime_error("Inconsistent pixmap widths");
-    }
+  return magnitude;
+}
+
+static bool edgesEnabled(const AsciiParams &params) {
+  return params.edgeOperator != EdgeOperator::None &&
+         params.edgeStrength > 0.0f;
+}
+
+static bool toneRemapEnabled(const AsciiParams &params) {
+  return params.toneRemap != ToneRemap::None &&
+         params.glyphSet == GlyphSet::Ascii &&
+         params.matching == GlyphMatching::Density;
+}
+
+static bool adaptiveEnabled(const AsciiParams &params) {
+  return params.adaptiveCells && params.glyphSet == GlyphSet::Ascii &&
+         params.matching == GlyphMatching::Density && !params.colorPreview;
+}
+
+/**
+ * Mean squared luminance over each cell of a grid of the given size, with the
+ * cell means it gives the luminance variance inside each cell.
+ */
+static cv::UMat cellMeanSquares(const cv::UMat &gray, const cv::Size &size) {
+  cv::UMat squared;
+  cv::multiply(gray, gray, squared);
+  cv::UMat meanSquares(size, CV_32F, cv::USAGE_ALLOCATE_DEVICE_MEMORY);
+  cv::resize(squared, meanSquares, size, 0, 0, cv::INTER_AREA);
+  return meanSquares;
+}
+
+/**
+ * Enqueues the tone remap of a single cell grid, empty when params leave it
+ * off. Still images derive it from their own histogram alone.
+ */
+static cv::UMat stillToneRemap(cv::ocl::Context &context,
+                               const cv::UMat &cells,
+                               const AsciiParams &params) {
+  if (!toneRemapEnabled(params)) {
+    return {};
+  }
+  ToneRemapState state;
+  tone_remap_update_ocl(context, cells, params.toneRemap, state);
+  return state.remap;
+}
+
+/**
+ * Pyramid levels to go up from the source while the level stays at least
+ * EDGE_PYRAMID_CELL_SCALE times wider than the cell grid.
+ */
+static int edgePyramidLevel(const cv::Size &source, const int columns) {
+  int level = 0;
+  for (int width = source.width;
+       (width + 1) / 2 >= EDGE_PYRAMID_CELL_SCALE * columns;
+       width = (width + 1) / 2) {
+    ++level;
+  }
+  return level;
+}
+
+/**
+ * Extends a grayscale pyramid whose first level is set up to level.
+ */
+static void buildPyramid(std::vector<cv::UMat> &pyramid, const int level) {
+  while (static_cast<int>(pyramid.size()) <= level) {
+    cv::UMat down;
+    cv::pyrDown(pyramid.back(), down);
+    pyramid.push_back(down);
+  }
+}
+
+/**
+ * Weights gray by 1 - strength * normalized edge magnitude, the magnitude
+ * being normalized to [0, 1] over [minMagnitude, maxMagnitude] like
+ * NORM_MINMAX.
+ */
+static void applyEdgeWeight(const cv::UMat &gray, const cv::UMat &magnitude,
+                            const double minMagnitude,
+                            const double maxMagnitude, const double strength,
+                            cv::UMat &weighted) {
+  const double range = maxMagnitude - minMagnitude;
+  const double scale = range > DBL_EPSILON ? strength / range : 0.0;
+  cv::UMat weight;
+  magnitude.convertTo(weight, CV_32F, -scale, 1.0 + minMagnitude * scale);
+  cv::multiply(gray, weight, weighted);
+}
+
+/**
+ * gray weighted by its complemented, normalized edge magnitude, which darkens
+ * edges. Without edge enhancement weighted is gray itself. Given a stream's
+ * normalization state, the Running and PreviousFrame modes normalize on the
+ * device without waiting for the frame, otherwise the exact range of the
+ * frame is read back.
+ */
+static void edgeWeightedGray(cv::ocl::Context &context, const cv::UMat &gray,
+                             const AsciiParams &params,
+                             EdgeNormalizationState *normalization,
+                             cv::UMat &weighted) {
+  if (!edgesEnabled(params)) {
+    weighted = gray;
+    return;
+  }
+  const cv::UMat magnitude = edgeMagnitude(gray, params.edgeOperator);
+  if (normalization &&
+      params.edgeNormalization != EdgeNormalization::MinMax) {
+    edge_weight_normalized_ocl(context, gray, magnitude,
+                               params.edgeNormalization, params.edgeStrength,
+                               *normalization, weighted);
+    return;
+  }
+  double minMagnitude = 0.0, maxMagnitude = 0.0;
+  cv::minMaxLoc(magnitude, &minMagnitude, &maxMagnitude);
+  applyEdgeWeight(gray, magnitude, minMagnitude, maxMagnitude,
+                  params.edgeStrength, weighted);
+}
+
+SubCellLayout cellSamples(const AsciiParams &params) {
+  if (params.glyphSet == GlyphSet::Ascii &&
+      params.matching == GlyphMatching::Structure) {
+    return {STRUCTURE_BLOCKS, STRUCTURE_BLOCKS};
   }
+  return glyphSetLayout(params.glyphSet);
+}
+
+/**
+ * Grid the luminance is resampled to: one value per cell, or a block of
+ * sub-cells per cell for structure matching and the bit pattern glyph sets.
+ */
+static cv::Size cellGridSize(const cv::Size &outputSize,
+                             const AsciiParams &params) {
+  const auto samples = cellSamples(params);
+  return {outputSize.width * samples.columns,
+          outputSize.height * samples.rows};
+}
+
+static double msSince(const std::chrono::steady_clock::time_point &start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+static void applyDithering(cv::ocl::Context &context, cv::UMat &cells,
+                           const DitheringType dithering) {
+  if (dithering == DitheringType::FloydSteinberg) {
+    applyFloydSteinberg(context, cells, 32);
+  } else if (dithering == DitheringType::Ordered) {
+    applyOrderedDither(cells);
+  }
+}
+
+/**
+ * The cache holds a reference to the input, so its buffer cannot be freed and
+ * handed out again while cached: equal buffers mean the same input.
+ */
+static bool sameInput(const cv::Mat &a, const cv::Mat &b) {
+  return a.u == b.u && a.data == b.data && a.size == b.size &&
+         a.type() == b.type() && a.step == b.step;
 }
 
 AsciiPipeline::Result AsciiPipeline::process(const cv::Mat &bgr,
                                              const AsciiParams &params) {
+  return host->execute([&] { return processStages(bgr, params); });
+}
+
+AsciiPipeline::Result AsciiPipeline::processStages(const cv::Mat &bgr,
+                                                   const AsciiParams &params) {
   if (bgr.empty()) {
     return {};
   }
+  const auto start = std::chrono::steady_clock::now();
+  if (!sameInput(stages.input, bgr)) {
+    stages = {};
+    stages.input = bgr;
+  }
   // compute rows from columns and font aspect
-  const double aspect = calibrator->cellAspect();
-  const int width = bgr.cols;
-  const int height = bgr.rows;
+  const int columns = std::max(8, params.columns);
+  const int rows = rowsForColumns(bgr.size(), columns,
+                                  engine->calibrator->cellAspect());
+  const cv::Size glyphSize(columns, rows);
+  const auto gridSize = cellGridSize(glyphSize, params);
+  const bool tiled =
+      static_cast<long long>(bgr.total()) > TILED_PIXEL_THRESHOLD;
+  const int edgeLevel =
+      tiled ? 0 : edgePyramidLevel(bgr.size(), gridSize.width);
+  const bool adaptive = adaptiveEnabled(params);
+
+  if (stages.edgeOperator != params.edgeOperator ||
+      stages.edgeStrength != params.edgeStrength ||
+      stages.edgeLevel != edgeLevel) {
+    stages.edgeWeighted.release();
+    stages.cells.release();
+    stages.edgeOperator = params.edgeOperator;
+    stages.edgeStrength = params.edgeStrength;
+    stages.edgeLevel = edgeLevel;
+  }
+
+  // tiled inputs average their colors in the same pass over the bands
+  const bool tiledColors =
+      tiled && params.colorPreview && stages.colors.size() != glyphSize;
+  if (stages.cells.empty() || stages.cells.size() != gridSize ||
+      (adaptive && stages.meanSquares.empty()) || tiledColors) {
+    stages.meanSquares.release();
+    if (tiled) {
+      cv::UMat gridColors;
+      stages.cells = tiledCells(
+          bgr.size(),
+          [&bgr](int firstRow, int rowCount) {
+            return bgr.rowRange(firstRow, firstRow + rowCount);
+          },
+          gridSize, params, TILED_BAND_PIXEL_BUDGET,
+          params.colorPreview ? &gridColors : nullptr,
+          adaptive ? &stages.meanSquares : nullptr);
+      if (params.colorPreview) {
+        // sub-cell grids are a whole multiple of the glyph grid
+        stages.colors = cellColors(gridColors, glyphSize);
+        stages.glyphs.release();
+      }
+    } else {
+      if (stages.edgeWeighted.empty()) {
+        if (stages.pyramid.empty()) {
+          stages.pyramid.push_back(grayFloat(bgr.getUMat(cv::ACCESS_READ)));
+        }
+        buildPyramid(stages.pyramid, edgeLevel);
+        edgeWeightedGray(clContext, stages.pyramid[edgeLevel], params,
+                         nullptr, stages.edgeWeighted);
+      }
+      stages.cells =
+          cv::UMat(gridSize, CV_32F, cv::USAGE_ALLOCATE_DEVICE_MEMORY);
+      cv::resize(stages.edgeWeighted, stages.cells, gridSize, 0, 0,
+                 cv::INTER_AREA);
+      if (adaptive) {
+        stages.meanSquares = cellMeanSquares(stages.edgeWeighted, gridSize);
+      }
+    }
+    stages.dithered.release();
+  }
+
+  if (stages.dithered.empty() || stages.dithering != params.dithering) {
+    // dithering works in place, keep the undithered cells for the next change
+    if (params.dithering == DitheringType::None) {
+      stages.dithered = stages.cells;
+    } else {
+      stages.cells.copyTo(stages.dithered);
+      applyDithering(clContext, stages.dithered, params.dithering);
+    }
+    stages.dithering = params.dithering;
+    stages.glyphs.release();
+  }
+
+  if (params.colorPreview && stages.colors.size() != glyphSize) {
+    stages.colors = cellColors(bgr.getUMat(cv::ACCESS_READ), glyphSize);
+    stages.glyphs.release();
+  }
+
+  if (stages.glyphs.empty() || stages.glyphsEngine != engine ||
+      stages.toneRemap != params.toneRemap ||
+      stages.colorPreview != params.colorPreview ||
+      stages.previewBackground != params.previewBackground ||
+      stages.adaptiveCells != adaptive) {
+    // the histogram is taken before dithering adds its noise, and so is the
+    // flatness of the adaptive layout
+    const cv::UMat remap = stillToneRemap(clContext, stages.cells, params);
+    AdaptiveLayout layout;
+    if (adaptive) {
+      // the layout maps the cells it keeps at 1x itself
+      layout = adaptiveLayout(stages.cells, stages.dithered,
+                              stages.meanSquares, remap);
+      stages.glyphs = layout.glyphs;
+    } else {
+      stages.glyphs = mapGlyphs(stages.dithered, params, remap);
+    }
+    stages.glyphsEngine = engine;
+    stages.toneRemap = params.toneRemap;
+    stages.colorPreview = params.colorPreview;
+    stages.previewBackground = params.previewBackground;
+    stages.adaptiveCells = adaptive;
+    syncSlot.submitted = start;
+    syncSlot.timings = {};
+    enqueueOutputs(syncSlot, stages.glyphs, stages.dithered,
+                   params.colorPreview ? stages.colors : cv::UMat(), params,
+                   layout);
+    syncSlot.timings.computeMs = msSince(start);
+    stages.result = collect(syncSlot);
+  }
+  return stages.result;
+}
+
+std::optional<AsciiPipeline::Result>
+AsciiPipeline::submit(const cv::Mat &bgr, const AsciiParams &params) {
+  return host->execute([&] { return submitFrame(bgr, params); });
+}
+
+std::optional<AsciiPipeline::Result>
+AsciiPipeline::submitFrame(const cv::Mat &bgr, const AsciiParams &params) {
+  if (bgr.empty()) {
+    return std::nullopt;
+  }
+  std::optional<Result> result;
+  if (inFlight.size() >= slots.size()) {
+    result = collectStreamed(slots[inFlight.front()]);
+    inFlight.pop_front();
+  }
+  const size_t slotIndex = nextSlot;
+  nextSlot = (nextSlot + 1) % slots.size();
+  auto &slot = slots[slotIndex];
+  slot.submitted = std::chrono::steady_clock::now();
+  slot.timings = {};
+
+  // a static frame only repeats the output if it would be produced the same way
+  if (!gatedParams || *gatedParams != params || gatedEngine != engine) {
+    motion.reset();
+    // the magnitude range and histogram of other settings do not carry over
+    streamNormalization.reset = true;
+    streamTone.reset = true;
+    gatedParams = params;
+    gatedEngine = engine;
+  }
+  slot.repeat = !motion.changed(bgr);
+  if (slot.repeat) {
+    inFlight.push_back(slotIndex);
+    return result;
+  }
 
+  const cv::Mat source = bgr.isContinuous() ? bgr : bgr.clone();
+  if (hostUnifiedMemory) {
+    // The device reads the frame in place: OpenCV wraps suitably aligned host
+    // memory with CL_MEM_USE_HOST_PTR on such devices. The slot keeps the
+    // frame referenced until its outputs were collected.
+    slot.source = source;
+    slot.input = slot.source.getUMat(cv::ACCESS_READ);
+  } else {
+    // Stage the frame in pinned memory and upload it on the transfer queue,
+    // the compute queue waits for the upload on the device, not on the host.
+    // The slot's previous upload completed when its outputs were collected.
+    const size_t bytes = source.total() * source.elemSize();
+    slot.upload.reserve(oclDefaultContext(), transferQueue, bytes);
+    host->parallelCopy(slot.upload.data(), source.data, bytes);
+    slot.input.create(source.size(), source.type(),
+                      cv::USAGE_ALLOCATE_DEVICE_MEMORY);
+    const cl::Event uploaded =
+        enqueueWriteUMat(transferQueue, slot.input, slot.upload.data(), {});
+    transferQueue.flush();
+    waitOnDefaultQueue(uploaded);
+  }
+  slot.timings.uploadMs = msSince(slot.submitted);
+
+  const auto computeStart = std::chrono::steady_clock::now();
   const int columns = std::max(8, params.columns);
-  const int rows =
-      std::max(4, static_cast<int>(std::round(static_cast<double>(height) /
-                                              static_cast<double>(width) *
-                                              columns / aspect)));
-  cv::UMat bgrGPU = bgr.getUMat(cv::ACCESS_RW);
-  cv::UMat grayUint(bgrGPU.size(), CV_8UC1, cv::USAGE_ALLOCATE_DEVICE_MEMORY);
-  cv::cvtColor(bgrGPU, grayUint, cv::COLOR_BGR2GRAY);
-  cv::UMat gray(grayUint.size(), CV_32F, cv::USAGE_ALLOCATE_DEVICE_MEMORY);
-  grayUint.convertTo(gray, CV_32F, 1 / 255.0);
+  const int rows = rowsForColumns(source.size(), columns,
+                                  engine->calibrator->cellAspect());
+  const auto gridSize = cellGridSize(cv::Size(columns, rows), params);
+  std::vector<cv::UMat> pyramid{grayFloat(slot.input)};
+  const int edgeLevel = edgePyramidLevel(source.size(), gridSize.width);
+  buildPyramid(pyramid, edgeLevel);
+  // neither the range of the previous scene
+  streamNormalization.reset =
+      streamNormalization.reset || motion.sceneCut();
+  cv::UMat weighted;
+  edgeWeightedGray(clContext, pyramid[edgeLevel], params, &streamNormalization,
+                   weighted);
+  cv::UMat cells(gridSize, CV_32F, cv::USAGE_ALLOCATE_DEVICE_MEMORY);
+  cv::resize(weighted, cells, gridSize, 0, 0, cv::INTER_AREA);
+  cv::UMat remap;
+  if (toneRemapEnabled(params)) {
+    streamTone.reset = streamTone.reset || motion.sceneCut();
+    tone_remap_update_ocl(clContext, cells, params.toneRemap, streamTone);
+    remap = streamTone.remap;
+  }
+  applyDithering(clContext, cells, params.dithering);
+  cv::UMat glyphs;
+  if (params.glyphHysteresis > 0.0f && params.glyphSet == GlyphSet::Ascii &&
+      params.matching == GlyphMatching::Density) {
+    // glyphs of the previous scene say nothing about the new one
+    glyphState.reset = glyphState.reset || motion.sceneCut();
+    glyphs = ascii_mapper_hysteresis_ocl(
+        clContext, cells, engine->deviceLut, glyphState,
+        params.glyphHysteresis, GLYPH_HYSTERESIS_SMOOTHING, outputUsage(),
+        launchConfig.mapLocalSize, remap);
+  } else {
+    glyphState.reset = true;
+    glyphs = mapGlyphs(cells, params, remap);
+  }
+  const cv::UMat colors = params.colorPreview
+                              ? cellColors(slot.input, cv::Size(columns, rows))
+                              : cv::UMat();
+  enqueueOutputs(slot, glyphs, cells, colors, params);
+  slot.timings.computeMs = msSince(computeStart);
+  inFlight.push_back(slotIndex);
+  return result;
+}
 
-  // Apply Sobel edge detection to highlight edges
-  cv::UMat sobelX, sobelY, sobel;
-  cv::Sobel(gray, sobelX, CV_32F, 2, 0, 5); // X gradient
-  cv::Sobel(gray, sobelY, CV_32F, 0, 2, 5); // Y gradient
-  cv::magnitude(sobelX, sobelY, sobel);     // Combine gradients
-  //
-  // Normalize Sobel result to [0, 1] range
-  cv::UMat sobelNorm;
-  cv::normalize(sobel, sobelNorm, 0.0, 1.0, cv::NORM_MINMAX);
-  cv::multiply(sobelNorm, -1, sobelNorm);
-  cv::add(sobelNorm, 1, sobelNorm);
-
-  // Multiply original grayscale with normalized Sobel to highlight edges
-  cv::multiply(gray, sobelNorm, gray);
-  const auto outputSize = cv::Size(columns, rows);
-  cv::UMat cells(outputSize, CV_32F, cv::USAGE_ALLOCATE_DEVICE_MEMORY);
-  cv::resize(gray, cells, outputSize, 0, 0, cv::INTER_AREA);
-
-  if (params.dithering == DitheringType::FloydSteinberg) {
-    applyFloydSteinberg(clContext, cells, 32);
-  } else if (params.dithering == DitheringType::Ordered) {
-    applyOrderedDither(cells);
+std::vector<AsciiPipeline::Result> AsciiPipeline::drain() {
+  std::vector<Result> results;
+  results.reserve(inFlight.size());
+  while (!inFlight.empty()) {
+    results.push_back(collectStreamed(slots[inFlight.front()]));
+    inFlight.pop_front();
   }
+  motion.reset();
+  streamResult = {};
+  glyphState.reset = true;
+  streamNormalization.reset = true;
+  streamTone.reset = true;
+  return results;
+}
 
-  Result result;
-  result.lines.resize(rows);
-
-  auto mappedUMatrix = ascii_mapper_ocl(clContext, cells, deviceLut);
-
-  auto linesMappingFuture = std::async(std::launch::async, [&mappedUMatrix,
-                                                            &result]() {
-    const auto mappedMatrix = mappedUMatrix.getMat(cv::ACCESS_READ).clone();
-    oneapi::tbb::parallel_for(
-        oneapi::tbb::blocked_range<int>(0, mappedMatrix.rows),
-        [&mappedMatrix, &result](const oneapi::tbb::blocked_range<int> &range) {
-          for (int row = range.begin(); row < range.end(); ++row) {
-            QString line;
-            line.reserve(mappedMatrix.cols);
-            const auto *row_ptr = mappedMatrix.ptr<uchar>(row);
-            for (int col = 0; col < mappedMatrix.cols; ++col) {
-              line.push_back(
-                  QChar::fromLatin1(static_cast<char>(row_ptr[col])));
-            }
-            result.lines[row] = std::move(line);
-          }
+std::vector<AsciiPipeline::Result>
+AsciiPipeline::processBatch(const std::vector<BatchFrame> &frames) {
+  return host->execute([&] { return processFrames(frames); });
+}
+
+/**
+ * Rows [first, first + count) of image, sharing its pixels.
+ */
+static QImage imageRows(const QImage &image, const int first,
+                        const int count) {
+  if (first == 0 && count == image.height()) {
+    return image;
+  }
+  return wrapInQImage(std::make_shared<const QImage>(image),
+                      image.constScanLine(first), image.width(), count,
+                      image.bytesPerLine(), image.format());
+}
+
+std::vector<AsciiPipeline::Result>
+AsciiPipeline::processFrames(const std::vector<BatchFrame> &frames) {
+  const auto start = std::chrono::steady_clock::now();
+  struct Prepared {
+    cv::UMat cells, colors, remap;
+    cv::Size glyphSize;
+  };
+  std::vector<Prepared> prepared(frames.size());
+  for (size_t i = 0; i < frames.size(); ++i) {
+    const auto &frame = frames[i];
+    if (frame.bgr.empty()) {
+      continue;
+    }
+    auto &frameCells = prepared[i];
+    AsciiParams params = frame.params;
+    const int columns = std::max(8, params.columns);
+    const int rows = rowsForColumns(frame.bgr.size(), columns,
+                                    engine->calibrator->cellAspect());
+    frameCells.glyphSize = cv::Size(columns, rows);
+    const auto gridSize = cellGridSize(frameCells.glyphSize, params);
+    const cv::UMat input = frame.bgr.getUMat(cv::ACCESS_READ);
+    std::vector<cv::UMat> pyramid{grayFloat(input)};
+    const int edgeLevel = edgePyramidLevel(frame.bgr.size(), gridSize.width);
+    buildPyramid(pyramid, edgeLevel);
+    // a fresh running range starts at the exact one, without the host sync
+    EdgeNormalizationState freshNormalization;
+    EdgeNormalizationState *normalization = frame.normalization;
+    if (!normalization ||
+        params.edgeNormalization == EdgeNormalization::MinMax) {
+      normalization = &freshNormalization;
+      params.edgeNormalization = EdgeNormalization::Running;
+    }
+    cv::UMat weighted;
+    edgeWeightedGray(clContext, pyramid[edgeLevel], params, normalization,
+                     weighted);
+    frameCells.cells =
+        cv::UMat(gridSize, CV_32F, cv::USAGE_ALLOCATE_DEVICE_MEMORY);
+    cv::resize(weighted, frameCells.cells, gridSize, 0, 0, cv::INTER_AREA);
+    if (toneRemapEnabled(params)) {
+      ToneRemapState freshTone;
+      ToneRemapState &tone = frame.tone ? *frame.tone : freshTone;
+      tone_remap_update_ocl(clContext, frameCells.cells, params.toneRemap,
+                            tone);
+      frameCells.remap = tone.remap;
+    }
+    applyDithering(clContext, frameCells.cells, params.dithering);
+    if (params.colorPreview) {
+      frameCells.colors = cellColors(input, frameCells.glyphSize);
+    }
+  }
+
+  // small frames drawn the same way from equally wide grids are stacked
+  const auto stackable = [&](const size_t i) {
+    return prepared[i].remap.empty() &&
+           prepared[i].glyphSize.area() <= BATCH_MAX_GLYPH_CELLS;
+  };
+  const auto sameOutput = [&](const size_t i, const size_t j) {
+    const AsciiParams &a = frames[i].params;
+    const AsciiParams &b = frames[j].params;
+    return prepared[i].cells.cols == prepared[j].cells.cols &&
+           a.glyphSet == b.glyphSet && a.matching == b.matching &&
+           a.colorPreview == b.colorPreview &&
+           (!a.colorPreview || a.previewBackground == b.previewBackground);
+  };
+  std::vector<std::vector<size_t>> groups;
+  for (size_t i = 0; i < frames.size(); ++i) {
+    if (prepared[i].cells.empty()) {
+      continue;
+    }
+    const auto group =
+        std::find_if(groups.begin(), groups.end(), [&](const auto &g) {
+          return stackable(i) && stackable(g.front()) &&
+                 sameOutput(i, g.front());
         });
+    if (group == groups.end()) {
+      groups.push_back({i});
+    } else {
+      group->push_back(i);
+    }
+  }
+
+  if (batchSlots.size() < groups.size()) {
+    batchSlots.resize(groups.size());
+  }
+  for (size_t g = 0; g < groups.size(); ++g) {
+    const auto &group = groups[g];
+    const auto &first = prepared[group.front()];
+    const AsciiParams &params = frames[group.front()].params;
+    cv::UMat cells, colors;
+    if (group.size() == 1) {
+      cells = first.cells;
+      colors = first.colors;
+    } else {
+      int cellRows = 0, glyphRows = 0;
+      for (const size_t i : group) {
+        cellRows += prepared[i].cells.rows;
+        glyphRows += prepared[i].glyphSize.height;
+      }
+      cells.create(cellRows, first.cells.cols, CV_32F,
+                   cv::USAGE_ALLOCATE_DEVICE_MEMORY);
+      if (params.colorPreview) {
+        colors.create(glyphRows, first.glyphSize.width, CV_8UC3,
+                      cv::USAGE_ALLOCATE_DEVICE_MEMORY);
+      }
+      int cellRow = 0, glyphRow = 0;
+      for (const size_t i : group) {
+        const auto &frameCells = prepared[i];
+        frameCells.cells.copyTo(
+            cells.rowRange(cellRow, cellRow + frameCells.cells.rows));
+        if (params.colorPreview) {
+          frameCells.colors.copyTo(colors.rowRange(
+              glyphRow, glyphRow + frameCells.glyphSize.height));
+        }
+        cellRow += frameCells.cells.rows;
+        glyphRow += frameCells.glyphSize.height;
+      }
+    }
+    auto &slot = batchSlots[g];
+    slot.submitted = start;
+    slot.timings = {};
+    const cv::UMat glyphs = mapGlyphs(cells, params, first.remap);
+    enqueueOutputs(slot, glyphs, cells, colors, params);
+    slot.timings.computeMs = msSince(start);
+  }
+
+  std::vector<Result> results(frames.size());
+  for (size_t g = 0; g < groups.size(); ++g) {
+    const Result stacked = collect(batchSlots[g]);
+    int cellRow = 0, glyphRow = 0;
+    for (const size_t i : groups[g]) {
+      const auto &frameCells = prepared[i];
+      const int glyphRows = frameCells.glyphSize.height;
+      Result &result = results[i];
+      result.glyphs = stacked.glyphs.rowRange(glyphRow, glyphRows);
+      result.preview =
+          imageRows(stacked.preview, glyphRow * engine->pixmapHeight,
+                    glyphRows * engine->pixmapHeight);
+      result.midImage =
+          imageRows(stacked.midImage, cellRow, frameCells.cells.rows);
+      if (!stacked.colors.isNull()) {
+        result.colors = imageRows(stacked.colors, glyphRow, glyphRows);
+      }
+      result.timings = stacked.timings;
+      cellRow += frameCells.cells.rows;
+      glyphRow += glyphRows;
+    }
+  }
+  return results;
+}
+
+void AsciiPipeline::setMotionThreshold(const double threshold) {
+  motion.setThreshold(threshold);
+}
+
+AsciiPipeline::Result AsciiPipeline::processTiled(const cv::Mat &bgr,
+                                                  const AsciiParams &params,
+                                                  long long bandPixelBudget) {
+  return processTiled(
+      bgr.size(),
+      [&bgr](int firstRow, int rowCount) {
+        return bgr.rowRange(firstRow, firstRow + rowCount);
+      },
+      params, bandPixelBudget);
+}
+
+AsciiPipeline::Result AsciiPipeline::processTiled(const cv::Size &sourceSize,
+                                                  const BandSource &source,
+                                                  const AsciiParams &params,
+                                                  long long bandPixelBudget) {
+  return host->execute([&] {
+    return processBands(sourceSize, source, params, bandPixelBudget);
   });
+}
+
+AsciiPipeline::Result AsciiPipeline::processBands(const cv::Size &sourceSize,
+                                                  const BandSource &source,
+                                                  const AsciiParams &params,
+                                                  long long bandPixelBudget) {
+  if (sourceSize.empty()) {
+    return {};
+  }
+  syncSlot.submitted = std::chrono::steady_clock::now();
+  syncSlot.timings = {};
+  const int columns = std::max(8, params.columns);
+  const int rows = rowsForColumns(sourceSize, columns,
+                                  engine->calibrator->cellAspect());
+  const cv::Size glyphSize(columns, rows);
+  const auto gridSize = cellGridSize(glyphSize, params);
+  const bool adaptive = adaptiveEnabled(params);
+  cv::UMat gridColors, meanSquares;
+  cv::UMat cells =
+      tiledCells(sourceSize, source, gridSize, params, bandPixelBudget,
+                 params.colorPreview ? &gridColors : nullptr,
+                 adaptive ? &meanSquares : nullptr);
+  const cv::UMat remap = stillToneRemap(clContext, cells, params);
+  // dithering works in place, the adaptive layout judges the cells before it
+  const cv::UMat undithered =
+      adaptive && params.dithering != DitheringType::None ? cells.clone()
+                                                           : cells;
+  applyDithering(clContext, cells, params.dithering);
+  const AdaptiveLayout layout =
+      adaptive ? adaptiveLayout(undithered, cells, meanSquares, remap)
+               : AdaptiveLayout();
+  const cv::UMat glyphs =
+      adaptive ? layout.glyphs : mapGlyphs(cells, params, remap);
+  // sub-cell grids are a whole multiple of the glyph grid
+  const cv::UMat colors = params.colorPreview
+                              ? cellColors(gridColors, glyphSize)
+                              : cv::UMat();
+  enqueueOutputs(syncSlot, glyphs, cells, colors, params, layout);
+  syncSlot.timings.computeMs = msSince(syncSlot.submitted);
+  return collect(syncSlot);
+}
+
+cv::UMat AsciiPipeline::tiledCells(const cv::Size &sourceSize,
+                                   const BandSource &source,
+                                   const cv::Size &outputSize,
+                                   const AsciiParams &params,
+                                   long long bandPixelBudget,
+                                   cv::UMat *colors, cv::UMat *meanSquares) {
+  const bool edgeEnhancement = edgesEnabled(params);
+  const int columns = outputSize.width;
+  const int rows = outputSize.height;
+  // first source row covered by a cell row, cell row `rows` maps to the end
+  const auto sourceRow = [&sourceSize, rows](int cellRow) {
+    return static_cast<int>(std::round(static_cast<double>(cellRow) *
+                                       sourceSize.height / rows));
+  };
+  const double sourceRowsPerCell =
+      static_cast<double>(sourceSize.height) / rows;
+  const int cellRowsPerBand = std::clamp(
+      static_cast<int>(static_cast<double>(bandPixelBudget) /
+                       (static_cast<double>(sourceSize.width) *
+                        sourceRowsPerCell)),
+      1, rows);
+
+  struct Band {
+    int firstCellRow, cellRows;
+    int haloTop, firstRow, lastRow, haloBottom;
+  };
+  std::vector<Band> bands;
+  for (int cellRow = 0; cellRow < rows; cellRow += cellRowsPerBand) {
+    Band band{};
+    band.firstCellRow = cellRow;
+    band.cellRows = std::min(cellRowsPerBand, rows - cellRow);
+    // every band covers at least one source row, even when there are more
+    // cell rows than source rows
+    band.firstRow = std::min(sourceRow(cellRow), sourceSize.height - 1);
+    band.lastRow =
+        std::max(band.firstRow + 1, sourceRow(cellRow + band.cellRows));
+    band.haloTop = std::max(0, band.firstRow - EDGE_KERNEL_HALO);
+    band.haloBottom =
+        std::min(sourceSize.height, band.lastRow + EDGE_KERNEL_HALO);
+    bands.push_back(band);
+  }
+
+  // Loads a band with its halo and returns its grayscale and edge magnitude
+  // cropped back to the band rows, and optionally the colors of its cells.
+  // With the halo in place the Sobel response of the band rows matches the
+  // full image one.
+  const auto loadBand = [&source, &params, edgeEnhancement, columns](
+                            const Band &band, cv::UMat &gray,
+                            cv::UMat &magnitude, cv::UMat *bandColors) {
+    const cv::Mat bgrBand =
+        source(band.haloTop, band.haloBottom - band.haloTop);
+    CV_Assert(bgrBand.rows == band.haloBottom - band.haloTop);
+    const cv::UMat haloGray = grayFloat(bgrBand.getUMat(cv::ACCESS_READ));
+    const cv::Rect crop(0, band.firstRow - band.haloTop, haloGray.cols,
+                        band.lastRow - band.firstRow);
+    gray = haloGray(crop);
+    if (edgeEnhancement) {
+      magnitude = edgeMagnitude(haloGray, params.edgeOperator)(crop);
+    }
+    if (bandColors) {
+      *bandColors =
+          cellColors(bgrBand(crop), cv::Size(columns, band.cellRows));
+    }
+  };
 
-  const auto display = ascii_draw_glyphs_ocl(
-      clContext, mappedUMatrix.clone(), deviceDensePixmaps, pixmapWidth, pixmapHeight,
-      pixmapWidth, pixmapHeight);
+  // The edge weight of a pixel is affine in its magnitude once the global
+  // range is known, w = g * (a - b * m), and area averaging is linear: cell
+  // means of g and g * m (and g^2, g^2 * m, g^2 * m^2 for the mean squares)
+  // gathered in one pass over the bands combine into the weighted cells at
+  // the end, so every band is read and its edges computed once.
+  const cv::Size gridSize(columns, rows);
+  const auto cellGrid = [&gridSize] {
+    return cv::UMat(gridSize, CV_32F, cv::USAGE_ALLOCATE_DEVICE_MEMORY);
+  };
+  cv::UMat cells = cellGrid();
+  cv::UMat grayMagnitude, squares, squaresMagnitude, squaresMagnitude2;
+  if (edgeEnhancement) {
+    grayMagnitude = cellGrid();
+  }
+  if (meanSquares) {
+    squares = cellGrid();
+    if (edgeEnhancement) {
+      squaresMagnitude = cellGrid();
+      squaresMagnitude2 = cellGrid();
+    }
+  }
+  if (colors) {
+    colors->create(gridSize, CV_8UC3, cv::USAGE_ALLOCATE_DEVICE_MEMORY);
+  }
+  double minMagnitude = std::numeric_limits<double>::max();
+  double maxMagnitude = std::numeric_limits<double>::lowest();
+  for (const auto &band : bands) {
+    cv::UMat gray, magnitude, bandColors;
+    loadBand(band, gray, magnitude, colors ? &bandColors : nullptr);
+    const cv::Rect bandRect(0, band.firstCellRow, columns, band.cellRows);
+    const auto cellMeans = [&bandRect](const cv::UMat &pixels,
+                                       const cv::UMat &grid) {
+      cv::UMat bandCells = grid(bandRect);
+      cv::resize(pixels, bandCells, bandCells.size(), 0, 0, cv::INTER_AREA);
+    };
+    cellMeans(gray, cells);
+    cv::UMat product;
+    if (edgeEnhancement) {
+      double bandMin = 0.0, bandMax = 0.0;
+      cv::minMaxLoc(magnitude, &bandMin, &bandMax);
+      minMagnitude = std::min(minMagnitude, bandMin);
+      maxMagnitude = std::max(maxMagnitude, bandMax);
+      cv::multiply(gray, magnitude, product);
+      cellMeans(product, grayMagnitude);
+    }
+    if (meanSquares) {
+      cv::UMat squared;
+      cv::multiply(gray, gray, squared);
+      cellMeans(squared, squares);
+      if (edgeEnhancement) {
+        cv::multiply(product, gray, product);
+        cellMeans(product, squaresMagnitude);
+        cv::multiply(product, magnitude, product);
+        cellMeans(product, squaresMagnitude2);
+      }
+    }
+    if (colors) {
+      bandColors.copyTo((*colors)(bandRect));
+    }
+  }
+  if (meanSquares) {
+    *meanSquares = squares;
+  }
+  if (!edgeEnhancement) {
+    return cells;
+  }
+  // same normalization as applyEdgeWeight
+  const double range = maxMagnitude - minMagnitude;
+  const double b = range > DBL_EPSILON ? params.edgeStrength / range : 0.0;
+  const double a = 1.0 + minMagnitude * b;
+  cv::UMat weighted = cellGrid();
+  cv::addWeighted(cells, a, grayMagnitude, -b, 0.0, weighted);
+  if (meanSquares) {
+    // (a - b * m)^2 = a^2 - 2ab * m + b^2 * m^2
+    cv::UMat weightedSquares = cellGrid();
+    cv::addWeighted(squares, a * a, squaresMagnitude, -2.0 * a * b, 0.0,
+                    weightedSquares);
+    cv::scaleAdd(squaresMagnitude2, b * b, weightedSquares, weightedSquares);
+    *meanSquares = weightedSquares;
+  }
+  return weighted;
+}
+
+cv::UMat AsciiPipeline::mapGlyphs(const cv::UMat &cells,
+                                  const AsciiParams &params,
+                                  const cv::UMat &remap) {
+  if (params.glyphSet != GlyphSet::Ascii) {
+    return ascii_pack_subcells_ocl(clContext, cells, params.glyphSet,
+                                   outputUsage(), launchConfig.mapLocalSize);
+  }
+  if (params.matching == GlyphMatching::Density) {
+    return ascii_mapper_ocl(clContext, cells, engine->deviceLut, outputUsage(),
+                            launchConfig.mapLocalSize, remap);
+  }
+  if (cv::ocl::useOpenCL()) {
+    return ascii_match_structure_ocl(clContext, cells, engine->deviceFeatures,
+                                     outputUsage(), launchConfig.mapLocalSize);
+  }
+  cv::Mat glyphs;
+  ascii_match_structure_cpu(cells.getMat(cv::ACCESS_READ), engine->features,
+                            glyphs);
+  return glyphs.getUMat(cv::ACCESS_READ).clone();
+}
+
+AdaptiveLayout AsciiPipeline::adaptiveLayout(const cv::UMat &cells,
+                                             const cv::UMat &dithered,
+                                             const cv::UMat &meanSquares,
+                                             const cv::UMat &remap) {
+  return ascii_adaptive_layout_ocl(
+      clContext, cells, dithered, meanSquares, engine->deviceLut,
+      engine->scaled(2).deviceLut,
+      engine->scaled(ADAPTIVE_CELL_MAX_SCALE).deviceLut, ADAPTIVE_CELL_FLATNESS,
+      outputUsage(), remap);
+}
+
+void AsciiPipeline::enqueueOutputs(FrameSlot &slot, const cv::UMat &glyphs,
+                                   const cv::UMat &cells,
+                                   const cv::UMat &colors,
+                                   const AsciiParams &params,
+                                   const AdaptiveLayout &layout) {
+  const auto context = oclDefaultContext();
+  // glyphs only depend on the mapper, their read starts before drawing ends
+  slot.glyphs = glyphs;
+  slot.glyphSet = params.glyphSet;
+  const cl::Event mapped = markDefaultQueue();
+  if (!layout.placements.empty()) {
+    // adaptive layouts are built for the grayscale preview only
+    slot.placements = layout.placements;
+    slot.preview = ascii_draw_placements_ocl(
+        clContext, layout.cover, engine->deviceDensePixmaps,
+        engine->scaled(2).devicePixmaps,
+        engine->scaled(ADAPTIVE_CELL_MAX_SCALE).devicePixmaps,
+        engine->pixmapWidth, engine->pixmapHeight, outputUsage(),
+        launchConfig);
+  } else if (colors.empty()) {
+    slot.preview = ascii_draw_glyphs_ocl(
+        clContext, slot.glyphs, engine->devicePixmaps(params.glyphSet),
+        engine->pixmapWidth, engine->pixmapHeight, engine->pixmapWidth,
+        engine->pixmapHeight, outputUsage(), launchConfig,
+        GlyphEngine::firstCode(params.glyphSet));
+  } else {
+    slot.colors = colors;
+    const QColor &background = params.previewBackground;
+    slot.preview = ascii_draw_glyphs_color_ocl(
+        clContext, slot.glyphs, slot.colors,
+        engine->devicePixmaps(params.glyphSet), engine->pixmapWidth,
+        engine->pixmapHeight,
+        cv::Vec3b(background.blue(), background.green(), background.red()),
+        outputUsage(), launchConfig, GlyphEngine::firstCode(params.glyphSet));
+  }
+  slot.midImage.create(cells.size(), CV_8UC1, outputUsage());
+  cells.convertTo(slot.midImage, CV_8UC1, 255);
+  const cl::Event drawn = markDefaultQueue();
+
+  if (hostUnifiedMemory) {
+    // mapping host allocated buffers exposes them without any copy
+    slot.glyphsMapped = enqueueMapUMat(transferQueue, slot.glyphs, {mapped});
+    if (!slot.colors.empty()) {
+      slot.colorsMapped = enqueueMapUMat(transferQueue, slot.colors, {mapped});
+    }
+    if (!slot.placements.empty()) {
+      slot.placementsMapped =
+          enqueueMapUMat(transferQueue, slot.placements, {mapped});
+    }
+    slot.previewMapped = enqueueMapUMat(transferQueue, slot.preview, {drawn});
+    slot.midImageMapped =
+        enqueueMapUMat(transferQueue, slot.midImage, {drawn});
+  } else {
+    slot.glyphsHost.reserve(context, transferQueue,
+                            slot.glyphs.total() * slot.glyphs.elemSize());
+    slot.previewHost.reserve(context, transferQueue,
+                             slot.preview.total() * slot.preview.elemSize());
+    slot.midImageHost.reserve(context, transferQueue,
+                              slot.midImage.total() *
+                                  slot.midImage.elemSize());
+    slot.glyphsRead = enqueueReadUMat(transferQueue, slot.glyphs,
+                                      slot.glyphsHost.data(), {mapped});
+    if (!slot.colors.empty()) {
+      slot.colorsHost.reserve(context, transferQueue,
+                              slot.colors.total() * slot.colors.elemSize());
+      slot.colorsRead = enqueueReadUMat(transferQueue, slot.colors,
+                                        slot.colorsHost.data(), {mapped});
+    }
+    if (!slot.placements.empty()) {
+      slot.placementsHost.reserve(context, transferQueue,
+                                  slot.placements.total() *
+                                      slot.placements.elemSize());
+      slot.placementsRead =
+          enqueueReadUMat(transferQueue, slot.placements,
+                          slot.placementsHost.data(), {mapped});
+    }
+    slot.previewRead = enqueueReadUMat(transferQueue, slot.preview,
+                                       slot.previewHost.data(), {drawn});
+    slot.midImageRead = enqueueReadUMat(transferQueue, slot.midImage,
+                                        slot.midImageHost.data(), {drawn});
+  }
+  transferQueue.flush();
+}
+
+/**
+ * Image over a slot output, sharing the mapped buffer on unified memory or
+ * copied out of the slot's pinned buffer, which the next frame reuses.
+ */
+static QImage outputImage(const cv::UMat &output,
+                          const std::shared_ptr<MappedUMat> &mapped,
+                          const cl::Event &read, const PinnedHostBuffer &host) {
+  // grayscale or, for the color preview, BGR
+  const bool bgr = output.type() == CV_8UC3;
+  if (mapped) {
+    mapped->ready.wait();
+    return wrapInQImage(
+        mapped, static_cast<const uchar *>(mapped->data), output.cols,
+        output.rows, static_cast<qsizetype>(output.cols * output.elemSize()),
+        bgr ? QImage::Format_BGR888 : QImage::Format_Grayscale8);
+  }
+  read.wait();
+  const cv::Mat image(output.size(), output.type(), host.data());
+  return (bgr ? matToQImage(image) : matToQImageGray(image)).copy();
+}
+
+/**
+ * Used placements of an adaptive layout, in block order
+ */
+static std::vector<GlyphPlacement> compactPlacements(const uint16_t *layout,
+                                                     const size_t count) {
+  std::vector<GlyphPlacement> placements;
+  for (size_t i = 0; i < count; ++i) {
+    const uint16_t *entry = layout + 4 * i;
+    // unused entries have scale 0
+    if (entry[3] != 0) {
+      placements.push_back({entry[0], entry[1],
+                            static_cast<uint8_t>(entry[2]),
+                            static_cast<uint8_t>(entry[3])});
+    }
+  }
+  return placements;
+}
+
+AsciiPipeline::Result AsciiPipeline::collectStreamed(FrameSlot &slot) {
+  if (slot.repeat) {
+    // images and glyphs are implicitly shared, only their handles are copied
+    Result repeated = streamResult;
+    repeated.repeated = true;
+    repeated.timings = slot.timings;
+    repeated.timings.latencyMs = msSince(slot.submitted);
+    return repeated;
+  }
+  streamResult = collect(slot);
+  return streamResult;
+}
 
-  result.preview = matToQImageGray(display);
-  linesMappingFuture.wait();
-  cv::Mat midImage;
-  cells.convertTo(midImage, CV_8UC1, 255);
-  result.midImage = matToQImageGray(midImage);
+AsciiPipeline::Result AsciiPipeline::collect(FrameSlot &slot) {
+  Result result;
+  result.timings = slot.timings;
+  // take the glyphs as soon as they arrived, while the preview is still being
+  // drawn or read back
+  auto waitStart = std::chrono::steady_clock::now();
+  const cv::Size glyphSize = slot.glyphs.size();
+  if (slot.glyphsMapped) {
+    slot.glyphsMapped->ready.wait();
+    result.timings.waitMs = msSince(waitStart);
+    // the grid keeps the mapping alive, like the images below
+    result.glyphs = GlyphGrid(
+        glyphSize.width, glyphSize.height, glyphSize.width,
+        static_cast<const uint8_t *>(slot.glyphsMapped->data),
+        slot.glyphsMapped, slot.glyphSet);
+  } else {
+    slot.glyphsRead.wait();
+    result.timings.waitMs = msSince(waitStart);
+    // the pinned buffer is reused by the slot's next frame
+    const auto textStart = std::chrono::steady_clock::now();
+    result.glyphs =
+        GlyphGrid::copyOf(glyphSize.width, glyphSize.height, glyphSize.width,
+                          slot.glyphsHost.data(), slot.glyphSet);
+    result.timings.textMs = msSince(textStart);
+  }
+
+  waitStart = std::chrono::steady_clock::now();
+  result.preview = outputImage(slot.preview, slot.previewMapped,
+                               slot.previewRead, slot.previewHost);
+  result.midImage = outputImage(slot.midImage, slot.midImageMapped,
+                                slot.midImageRead, slot.midImageHost);
+  if (!slot.colors.empty()) {
+    result.colors = outputImage(slot.colors, slot.colorsMapped,
+                                slot.colorsRead, slot.colorsHost);
+  }
+  if (slot.placementsMapped) {
+    slot.placementsMapped->ready.wait();
+    result.placements = compactPlacements(
+        static_cast<const uint16_t *>(slot.placementsMapped->data),
+        slot.placements.total());
+  } else if (!slot.placements.empty()) {
+    slot.placementsRead.wait();
+    result.placements = compactPlacements(
+        reinterpret_cast<const uint16_t *>(slot.placementsHost.data()),
+        slot.placements.total());
+  }
+  result.timings.waitMs += msSince(waitStart);
+  result.timings.latencyMs = msSince(slot.submitted);
+  // mapped previews stay alive through the images, device buffers go back to
+  // OpenCV's pool once unmapped, staged inputs stay for reuse
+  slot.glyphsMapped.reset();
+  slot.colorsMapped.reset();
+  slot.placementsMapped.reset();
+  slot.previewMapped.reset();
+  slot.midImageMapped.reset();
+  slot.glyphs.release();
+  slot.colors.release();
+  slot.placements.release();
+  slot.preview.release();
+  slot.midImage.release();
+  if (!slot.source.empty()) {
+    slot.input.release();
+    slot.source.release();
+  }
   return result;
 }
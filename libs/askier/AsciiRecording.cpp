@@ -0,0 +1,432 @@
+#include "askier/AsciiRecording.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+constexpr char RECORDING_MAGIC[4] = {'A', 'S', 'K', 'R'};
+constexpr char INDEX_MAGIC[4] = {'A', 'S', 'K', 'I'};
+constexpr uint16_t RECORDING_VERSION = 1;
+constexpr size_t HEADER_BYTES = 8;
+constexpr size_t RECORD_HEADER_BYTES = 18;
+constexpr size_t INDEX_ENTRY_BYTES = 20;
+constexpr size_t FOOTER_BYTES = 16;
+constexpr uint8_t KEYFRAME = 0;
+constexpr uint8_t DELTA = 1;
+constexpr uint8_t FRAME_HAS_COLOR = 1;
+// PackBits: runs of at least this many equal bytes are worth a run header
+constexpr size_t MIN_RUN = 3;
+constexpr size_t MAX_PACKET = 128;
+
+static void putU16(std::vector<uint8_t> &out, const uint16_t value) {
+    out.push_back(static_cast<uint8_t>(value));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+static void putU32(std::vector<uint8_t> &out, const uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+static void putU64(std::vector<uint8_t> &out, const uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+static uint16_t getU16(const uint8_t *p) {
+    return static_cast<uint16_t>(p[0] | p[1] << 8);
+}
+
+static uint32_t getU32(const uint8_t *p) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; --i) {
+        value = value << 8 | p[i];
+    }
+    return value;
+}
+
+static uint64_t getU64(const uint8_t *p) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; --i) {
+        value = value << 8 | p[i];
+    }
+    return value;
+}
+
+static size_t runLength(const uint8_t *data, const size_t size, const size_t at) {
+    size_t run = 1;
+    while (at + run < size && run < MAX_PACKET && data[at + run] == data[at]) {
+        ++run;
+    }
+    return run;
+}
+
+/**
+ * PackBits: a header byte h below 128 is followed by h + 1 literal bytes,
+ * otherwise the next byte repeats 257 - h times.
+ */
+static void packBits(const uint8_t *data, const size_t size, std::vector<uint8_t> &out) {
+    size_t i = 0;
+    while (i < size) {
+        const size_t run = runLength(data, size, i);
+        if (run >= MIN_RUN) {
+            out.push_back(static_cast<uint8_t>(257 - run));
+            out.push_back(data[i]);
+            i += run;
+            continue;
+        }
+        size_t literal = run;
+        while (i + literal < size && literal < MAX_PACKET && runLength(data, size, i + literal) < MIN_RUN) {
+            ++literal;
+        }
+        out.push_back(static_cast<uint8_t>(literal - 1));
+        out.insert(out.end(), data + i, data + i + literal);
+        i += literal;
+    }
+}
+
+static const uint8_t *unpackBits(const uint8_t *in, const uint8_t *end, uint8_t *out, const size_t size) {
+    size_t produced = 0;
+    while (produced < size) {
+        if (in >= end) {
+            return nullptr;
+        }
+        const uint8_t header = *in++;
+        if (header < 128) {
+            const size_t literal = header + 1u;
+            if (literal > size - produced || static_cast<size_t>(end - in) < literal) {
+                return nullptr;
+            }
+            std::memcpy(out + produced, in, literal);
+            in += literal;
+            produced += literal;
+        } else {
+            const size_t run = 257u - header;
+            if (run > size - produced || in >= end) {
+                return nullptr;
+            }
+            std::memset(out + produced, *in++, run);
+            produced += run;
+        }
+    }
+    return in;
+}
+
+AsciiFrame asciiFrameFromGrid(const GlyphGrid &grid, const int64_t timestampUs) {
+    AsciiFrame frame;
+    frame.timestampUs = timestampUs;
+    frame.columns = grid.columns();
+    frame.rows = grid.rows();
+    frame.glyphs.resize(static_cast<size_t>(frame.columns) * frame.rows);
+    for (int y = 0; y < frame.rows; ++y) {
+        std::memcpy(frame.glyphs.data() + static_cast<size_t>(y) * frame.columns, grid.row(y), frame.columns);
+    }
+    return frame;
+}
+
+AsciiRecordingWriter::AsciiRecordingWriter(const std::string &path, const RecordingCharset charset,
+                                           const int keyframeInterval)
+    : out(path, std::ios::binary | std::ios::trunc), charsetCode(charset),
+      keyframeInterval(std::max(1, keyframeInterval)) {
+    if (!out) {
+        throw std::runtime_error("Failed to create recording " + path);
+    }
+    std::vector<uint8_t> header(RECORDING_MAGIC, RECORDING_MAGIC + 4);
+    putU16(header, RECORDING_VERSION);
+    header.push_back(static_cast<uint8_t>(charset));
+    header.push_back(0);
+    write(header);
+    worker = std::thread(&AsciiRecordingWriter::run, this);
+}
+
+AsciiRecordingWriter::~AsciiRecordingWriter() {
+    try {
+        close();
+    } catch (const std::exception &) {
+        // nothing left to report to
+    }
+}
+
+bool AsciiRecordingWriter::push(AsciiFrame frame, const bool wait) {
+    // records hold the grid size in 16 bits
+    if (frame.columns < 0 || frame.rows < 0 || frame.columns > UINT16_MAX || frame.rows > UINT16_MAX) {
+        throw std::runtime_error("Recorded frames are limited to 65535 columns and rows, got " +
+                                 std::to_string(frame.columns) + "x" + std::to_string(frame.rows));
+    }
+    std::unique_lock lock(mutex);
+    if (closing) {
+        return false;
+    }
+    if (queue.size() >= RECORDING_QUEUE_FRAMES) {
+        if (!wait) {
+            ++dropped;
+            return false;
+        }
+        changed.wait(lock, [this]() { return queue.size() < RECORDING_QUEUE_FRAMES; });
+    }
+    queue.push_back(std::move(frame));
+    lock.unlock();
+    changed.notify_all();
+    return true;
+}
+
+void AsciiRecordingWriter::run() {
+    std::unique_lock lock(mutex);
+    while (true) {
+        changed.wait(lock, [this]() { return closing || !queue.empty(); });
+        if (queue.empty()) {
+            return;
+        }
+        AsciiFrame frame = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+        changed.notify_all();
+        writeFrame(frame);
+        lock.lock();
+    }
+}
+
+void AsciiRecordingWriter::write(const std::vector<uint8_t> &data) {
+    out.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+    bytes += data.size();
+}
+
+void AsciiRecordingWriter::writeFrame(const AsciiFrame &frame) {
+    const size_t cells = static_cast<size_t>(frame.columns) * frame.rows;
+    if (frame.glyphs.size() != cells || (!frame.colors.empty() && frame.colors.size() != 3 * cells)) {
+        ++dropped;
+        return;
+    }
+    const auto frameNumber = static_cast<uint32_t>(index.size());
+    const bool keyframe = index.empty() || frameNumber - lastKeyframe >= static_cast<uint32_t>(keyframeInterval) ||
+                          frame.columns != previous.columns || frame.rows != previous.rows ||
+                          frame.colors.empty() != previous.colors.empty();
+    if (keyframe) {
+        lastKeyframe = frameNumber;
+    }
+
+    record.clear();
+    record.push_back(keyframe ? KEYFRAME : DELTA);
+    record.push_back(frame.colors.empty() ? 0 : FRAME_HAS_COLOR);
+    putU16(record, static_cast<uint16_t>(frame.columns));
+    putU16(record, static_cast<uint16_t>(frame.rows));
+    putU32(record, 0); // payload size, patched below
+    putU64(record, static_cast<uint64_t>(frame.timestampUs));
+    const auto encodePlane = [this, keyframe](const std::vector<uint8_t> &data, const std::vector<uint8_t> &before) {
+        if (keyframe) {
+            packBits(data.data(), data.size(), record);
+            return;
+        }
+        plane.resize(data.size());
+        for (size_t i = 0; i < data.size(); ++i) {
+            plane[i] = data[i] ^ before[i];
+        }
+        packBits(plane.data(), plane.size(), record);
+    };
+    encodePlane(frame.glyphs, previous.glyphs);
+    if (!frame.colors.empty()) {
+        encodePlane(frame.colors, previous.colors);
+    }
+    const auto payloadBytes = static_cast<uint32_t>(record.size() - RECORD_HEADER_BYTES);
+    for (int i = 0; i < 4; ++i) {
+        record[6 + i] = static_cast<uint8_t>(payloadBytes >> (8 * i));
+    }
+
+    index.push_back({bytes, frame.timestampUs, lastKeyframe});
+    write(record);
+    previous = frame;
+    ++written;
+}
+
+void AsciiRecordingWriter::close() {
+    {
+        std::lock_guard lock(mutex);
+        if (closed) {
+            return;
+        }
+        closing = true;
+        closed = true;
+    }
+    changed.notify_all();
+    worker.join();
+
+    const uint64_t indexOffset = bytes;
+    std::vector<uint8_t> trailer;
+    trailer.reserve(index.size() * INDEX_ENTRY_BYTES + FOOTER_BYTES);
+    for (const auto &entry: index) {
+        putU64(trailer, entry.offset);
+        putU64(trailer, static_cast<uint64_t>(entry.timestampUs));
+        putU32(trailer, entry.keyframe);
+    }
+    putU64(trailer, indexOffset);
+    putU32(trailer, static_cast<uint32_t>(index.size()));
+    trailer.insert(trailer.end(), INDEX_MAGIC, INDEX_MAGIC + 4);
+    write(trailer);
+    out.close();
+    if (!out) {
+        throw std::runtime_error("Failed to write recording");
+    }
+}
+
+AsciiRecordingReader::AsciiRecordingReader(const std::string &path) : in(path, std::ios::binary) {
+    if (!in) {
+        throw std::runtime_error("Failed to open recording " + path);
+    }
+    in.seekg(0, std::ios::end);
+    const auto fileSize = static_cast<uint64_t>(in.tellg());
+    in.seekg(0);
+    uint8_t header[HEADER_BYTES];
+    if (fileSize < HEADER_BYTES || !in.read(reinterpret_cast<char *>(header), HEADER_BYTES) ||
+        std::memcmp(header, RECORDING_MAGIC, 4) != 0) {
+        throw std::runtime_error("Not an ASCII recording: " + path);
+    }
+    if (getU16(header + 4) != RECORDING_VERSION) {
+        throw std::runtime_error("Unsupported recording version in " + path);
+    }
+    if (header[6] > static_cast<uint8_t>(GlyphSet::Blocks)) {
+        throw std::runtime_error("Unsupported charset in " + path);
+    }
+    charsetCode = static_cast<RecordingCharset>(header[6]);
+    if (!readIndex(fileSize)) {
+        scanIndex(fileSize);
+    }
+}
+
+bool AsciiRecordingReader::readIndex(const uint64_t fileSize) {
+    if (fileSize < HEADER_BYTES + FOOTER_BYTES) {
+        return false;
+    }
+    uint8_t footer[FOOTER_BYTES];
+    in.seekg(static_cast<std::streamoff>(fileSize - FOOTER_BYTES));
+    if (!in.read(reinterpret_cast<char *>(footer), FOOTER_BYTES) || std::memcmp(footer + 12, INDEX_MAGIC, 4) != 0) {
+        in.clear();
+        return false;
+    }
+    const uint64_t indexOffset = getU64(footer);
+    const uint32_t count = getU32(footer + 8);
+    if (indexOffset + static_cast<uint64_t>(count) * INDEX_ENTRY_BYTES + FOOTER_BYTES != fileSize) {
+        return false;
+    }
+    std::vector<uint8_t> entries(static_cast<size_t>(count) * INDEX_ENTRY_BYTES);
+    in.seekg(static_cast<std::streamoff>(indexOffset));
+    if (!in.read(reinterpret_cast<char *>(entries.data()), static_cast<std::streamsize>(entries.size()))) {
+        in.clear();
+        return false;
+    }
+    index.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint8_t *p = entries.data() + static_cast<size_t>(i) * INDEX_ENTRY_BYTES;
+        index[i] = {getU64(p), static_cast<int64_t>(getU64(p + 8)), getU32(p + 16)};
+    }
+    return true;
+}
+
+void AsciiRecordingReader::scanIndex(const uint64_t fileSize) {
+    // the writer did not finish, walk the records up to the first truncated one
+    index.clear();
+    uint64_t offset = HEADER_BYTES;
+    uint32_t keyframe = 0;
+    uint8_t header[RECORD_HEADER_BYTES];
+    while (offset + RECORD_HEADER_BYTES <= fileSize) {
+        in.seekg(static_cast<std::streamoff>(offset));
+        if (!in.read(reinterpret_cast<char *>(header), RECORD_HEADER_BYTES)) {
+            break;
+        }
+        const uint64_t end = offset + RECORD_HEADER_BYTES + getU32(header + 6);
+        if (end > fileSize || header[0] > DELTA) {
+            break;
+        }
+        if (header[0] == KEYFRAME) {
+            keyframe = static_cast<uint32_t>(index.size());
+        }
+        index.push_back({offset, static_cast<int64_t>(getU64(header + 10)), keyframe});
+        offset = end;
+    }
+    in.clear();
+}
+
+int64_t AsciiRecordingReader::timestampUs(const size_t frame) const {
+    return index.at(frame).timestampUs;
+}
+
+size_t AsciiRecordingReader::frameAt(const int64_t timestampUs) const {
+    const auto it = std::upper_bound(index.begin(), index.end(), timestampUs,
+                                     [](const int64_t t, const IndexEntry &entry) { return t < entry.timestampUs; });
+    return it == index.begin() ? 0 : static_cast<size_t>(it - index.begin() - 1);
+}
+
+const AsciiFrame &AsciiRecordingReader::frame(const size_t frame) {
+    if (frame >= index.size()) {
+        throw std::out_of_range("Recording frame out of range");
+    }
+    if (frame == currentFrame) {
+        return current;
+    }
+    // continue from the decoded frame when it lies between the keyframe and the target
+    const size_t keyframe = index[frame].keyframe;
+    size_t next = currentFrame != SIZE_MAX && currentFrame >= keyframe && currentFrame < frame
+                      ? currentFrame + 1
+                      : keyframe;
+    for (; next <= frame; ++next) {
+        decode(next);
+    }
+    return current;
+}
+
+void AsciiRecordingReader::decode(const size_t frame) {
+    const auto &entry = index[frame];
+    uint8_t header[RECORD_HEADER_BYTES];
+    in.seekg(static_cast<std::streamoff>(entry.offset));
+    if (!in.read(reinterpret_cast<char *>(header), RECORD_HEADER_BYTES)) {
+        in.clear();
+        throw std::runtime_error("Truncated recording frame " + std::to_string(frame));
+    }
+    payload.resize(getU32(header + 6));
+    if (!in.read(reinterpret_cast<char *>(payload.data()), static_cast<std::streamsize>(payload.size()))) {
+        in.clear();
+        throw std::runtime_error("Truncated recording frame " + std::to_string(frame));
+    }
+    const bool keyframe = header[0] == KEYFRAME;
+    const bool hasColor = header[1] & FRAME_HAS_COLOR;
+    const int columns = getU16(header + 2);
+    const int rows = getU16(header + 4);
+    if (!keyframe && (currentFrame + 1 != frame || columns != current.columns || rows != current.rows)) {
+        throw std::runtime_error("Recording delta without its previous frame " + std::to_string(frame));
+    }
+    const size_t cells = static_cast<size_t>(columns) * rows;
+    current.columns = columns;
+    current.rows = rows;
+    current.timestampUs = static_cast<int64_t>(getU64(header + 10));
+
+    const uint8_t *cursor = payload.data();
+    const uint8_t *end = cursor + payload.size();
+    const auto decodePlane = [&](std::vector<uint8_t> &data, const size_t size) {
+        if (keyframe) {
+            data.resize(size);
+            cursor = cursor ? unpackBits(cursor, end, data.data(), size) : nullptr;
+            return;
+        }
+        plane.resize(size);
+        cursor = cursor && data.size() == size ? unpackBits(cursor, end, plane.data(), size) : nullptr;
+        if (cursor) {
+            for (size_t i = 0; i < size; ++i) {
+                data[i] ^= plane[i];
+            }
+        }
+    };
+    decodePlane(current.glyphs, cells);
+    if (hasColor) {
+        decodePlane(current.colors, 3 * cells);
+    } else {
+        current.colors.clear();
+    }
+    if (!cursor) {
+        currentFrame = SIZE_MAX;
+        throw std::runtime_error("Corrupt recording frame " + std::to_string(frame));
+    }
+    currentFrame = frame;
+}
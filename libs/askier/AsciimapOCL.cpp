@@ -1,5 +1,8 @@
 #include "askier/AsciimapOCL.hpp"
 #include <askier/Constants.hpp>
+#include <askier/KernelAutotuner.hpp>
+#include <askier/OclProgramCache.hpp>
+#include <askier/ToneRemapOCL.hpp>
 
 #include <opencv2/core/mat.hpp>
 #include <opencv2/core/ocl.hpp>
@@ -15,6 +18,9 @@ int src_rows,
 int src_cols,
 int lut_size,
 int dst_cols
+#ifdef TONE_REMAP
+, __global const float *remap
+#endif
 )
 {
     const int x = get_global_id(0);
@@ -27,7 +33,13 @@ int dst_cols
     const int source_idx = y * src_cols  + x ;
     const int dst_idx = y * dst_cols + x;
 
-    const float luminance = src[source_idx];
+    float luminance = src[source_idx];
+#ifdef TONE_REMAP
+    // remap sampled at the bin centres, interpolated in between
+    const float position = clamp(luminance, 0.0f, 1.0f) * (TONE_REMAP_BINS - 1);
+    const int bin = min((int) position, TONE_REMAP_BINS - 2);
+    luminance = mix(remap[bin], remap[bin + 1], position - (float) bin);
+#endif
     const float darkness = 1.0f - luminance;
 
     const int max_lut_index = lut_size - 1;
@@ -42,19 +54,17 @@ int dst_cols
 )SRC";
 
 cv::UMat ascii_mapper_ocl(cv::ocl::Context &context, const cv::UMat &src,
-                         const cv::UMat &deviceLut) {
+                         const cv::UMat &deviceLut, cv::UMatUsageFlags usage,
+                         const std::array<size_t, 2> &localSize, const cv::UMat &remap) {
     CV_Assert(src.type() == CV_32F);
     CV_Assert(deviceLut.type() == CV_8U);
     CV_Assert(deviceLut.rows == 1);
     CV_Assert(deviceLut.cols == ASCII_COUNT);
-    cv::UMat dst(src.size(), CV_8U, cv::USAGE_ALLOCATE_DEVICE_MEMORY);
+    cv::UMat dst(src.size(), CV_8U, usage);
 
-    cv::ocl::ProgramSource source(kernel_source);
-    std::string compileErrors;
-    cv::ocl::Program program = context.getProg(source, "", compileErrors);
-    if (program.empty()) {
-        throw std::runtime_error("OpenCL ascii mapper compilation failed" + compileErrors);
-    }
+    const bool remapped = !remap.empty();
+    const cv::ocl::Program program = oclProgram(context, kernel_source, remapped ? tone_remap_build_options() : "",
+                                                "ascii mapper");
     cv::ocl::Kernel kernel("ascii_map_lut", program);
     CV_Assert(!kernel.empty());
     CV_Assert(src.isContinuous());
@@ -71,13 +81,17 @@ cv::UMat ascii_mapper_ocl(cv::ocl::Context &context, const cv::UMat &src,
         ASCII_COUNT,
         dst.cols
     );
+    if (remapped) {
+        CV_Assert(remap.type() == CV_32F && remap.total() == static_cast<size_t>(TONE_REMAP_BINS));
+        kernel.set(7, cv::ocl::KernelArg::PtrReadOnly(remap));
+    }
 
 
 
 
-    size_t globals[2] = {static_cast<size_t>(src.cols), static_cast<size_t>(src.rows)};
-    bool run_ok = kernel.run(2, globals, nullptr, true);
+    // enqueue only, consumers are ordered after it on the same queue
+    bool run_ok = runKernel2D(kernel, src.cols, src.rows, localSize, false);
     CV_Assert(run_ok);
 
-    return dst.clone();
+    return dst;
 }
\ No newline at end of file
@@ -0,0 +1,178 @@
+#include "askier/EdgeNormalizationOCL.hpp"
+#include <askier/Constants.hpp>
+#include <askier/OclProgramCache.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <opencv2/core/mat.hpp>
+#include <opencv2/core/ocl.hpp>
+
+
+static std::string kernel_source = R"SRC(
+kernel void edge_minmax_reduce(
+__global const float *magnitude,
+int total,
+__global uint *frame_stats,
+__local float *local_min,
+__local float *local_max
+)
+{
+    const int lid = get_local_id(0);
+    float lo = INFINITY;
+    float hi = 0.0f;
+    for (int i = get_global_id(0); i < total; i += get_global_size(0)) {
+        const float m = magnitude[i];
+        lo = fmin(lo, m);
+        hi = fmax(hi, m);
+    }
+    local_min[lid] = lo;
+    local_max[lid] = hi;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int s = get_local_size(0) / 2; s > 0; s >>= 1) {
+        if (lid < s) {
+            local_min[lid] = fmin(local_min[lid], local_min[lid + s]);
+            local_max[lid] = fmax(local_max[lid], local_max[lid + s]);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (lid == 0) {
+        // non-negative floats order like their bit patterns
+        atomic_min(&frame_stats[0], as_uint(local_min[0]));
+        atomic_max(&frame_stats[1], as_uint(local_max[0]));
+    }
+}
+
+kernel void edge_stats_update(
+__global uint *frame_stats,
+__global float *stats,
+int mode,
+float smoothing,
+int reset
+)
+{
+    const float frame_min = as_float(frame_stats[0]);
+    const float frame_max = as_float(frame_stats[1]);
+    if (reset) {
+        stats[0] = frame_min;
+        stats[1] = frame_max;
+    } else if (mode == 1) {
+        // running
+        stats[0] = mix(stats[0], frame_min, smoothing);
+        stats[1] = mix(stats[1], frame_max, smoothing);
+    } else {
+        // previous frame
+        stats[0] = stats[2];
+        stats[1] = stats[3];
+    }
+    stats[2] = frame_min;
+    stats[3] = frame_max;
+    frame_stats[0] = as_uint(INFINITY);
+    frame_stats[1] = 0u;
+}
+
+kernel void edge_weight(
+__global const float *gray,
+__global const float *magnitude,
+__global const float *stats,
+__global float *weighted,
+int total,
+float strength
+)
+{
+    const int i = get_global_id(0);
+    if (i >= total) {
+        return;
+    }
+    const float range = stats[1] - stats[0];
+    // a range from other frames may not cover this one
+    const float normalized = range > FLT_EPSILON ? clamp((magnitude[i] - stats[0]) / range, 0.0f, 1.0f) : 0.0f;
+    weighted[i] = gray[i] * (1.0f - strength * normalized);
+}
+)SRC";
+
+// upper bound of work-groups in the reduction, each loops over its share
+constexpr size_t MAX_REDUCTION_GROUPS = 256;
+
+static size_t reductionLocalSize() {
+    const size_t maxSize = std::min<size_t>(256, cv::ocl::Device::getDefault().maxWorkGroupSize());
+    // the tree reduction halves the group
+    size_t size = 1;
+    while (size * 2 <= maxSize) {
+        size *= 2;
+    }
+    return size;
+}
+
+static void initState(EdgeNormalizationState &state) {
+    if (!state.frameStats.empty()) {
+        return;
+    }
+    constexpr float infinity = std::numeric_limits<float>::infinity();
+    int32_t infinityBits = 0;
+    std::memcpy(&infinityBits, &infinity, sizeof(infinityBits));
+    const cv::Mat frameStats = (cv::Mat_<int32_t>(1, 2) << infinityBits, 0);
+    frameStats.copyTo(state.frameStats);
+    state.stats.create(1, 4, CV_32F, cv::USAGE_ALLOCATE_DEVICE_MEMORY);
+    state.reset = true;
+}
+
+void edge_weight_normalized_ocl(cv::ocl::Context &context, const cv::UMat &gray, const cv::UMat &magnitude,
+                                const EdgeNormalization mode, const float strength,
+                                EdgeNormalizationState &state, cv::UMat &weighted) {
+    CV_Assert(mode != EdgeNormalization::MinMax);
+    CV_Assert(gray.type() == CV_32F && magnitude.type() == CV_32F);
+    CV_Assert(gray.size() == magnitude.size());
+    CV_Assert(gray.isContinuous() && magnitude.isContinuous());
+    initState(state);
+    weighted.create(gray.size(), CV_32F, cv::USAGE_ALLOCATE_DEVICE_MEMORY);
+    const int total = static_cast<int>(gray.total());
+
+    const cv::ocl::Program program = oclProgram(context, kernel_source, "", "edge normalization");
+
+    cv::ocl::Kernel reduce("edge_minmax_reduce", program);
+    CV_Assert(!reduce.empty());
+    const size_t localSize = reductionLocalSize();
+    reduce.args(
+        cv::ocl::KernelArg::PtrReadOnly(magnitude),
+        total,
+        cv::ocl::KernelArg::PtrReadWrite(state.frameStats),
+        cv::ocl::KernelArg::Local(localSize * sizeof(float)),
+        cv::ocl::KernelArg::Local(localSize * sizeof(float))
+    );
+    const size_t groups = std::clamp<size_t>((static_cast<size_t>(total) + localSize - 1) / localSize, 1,
+                                             MAX_REDUCTION_GROUPS);
+    size_t reduceGlobal[1] = {groups * localSize};
+    size_t reduceLocal[1] = {localSize};
+    CV_Assert(reduce.run(1, reduceGlobal, reduceLocal, false));
+
+    cv::ocl::Kernel update("edge_stats_update", program);
+    CV_Assert(!update.empty());
+    update.args(
+        cv::ocl::KernelArg::PtrReadWrite(state.frameStats),
+        cv::ocl::KernelArg::PtrReadWrite(state.stats),
+        static_cast<int>(mode),
+        EDGE_NORMALIZATION_SMOOTHING,
+        state.reset ? 1 : 0
+    );
+    size_t single[1] = {1};
+    CV_Assert(update.run(1, single, nullptr, false));
+    state.reset = false;
+
+    cv::ocl::Kernel weight("edge_weight", program);
+    CV_Assert(!weight.empty());
+    weight.args(
+        cv::ocl::KernelArg::PtrReadOnly(gray),
+        cv::ocl::KernelArg::PtrReadOnly(magnitude),
+        cv::ocl::KernelArg::PtrReadOnly(state.stats),
+        cv::ocl::KernelArg::PtrWriteOnly(weighted),
+        total,
+        strength
+    );
+    size_t weightGlobal[1] = {static_cast<size_t>(total)};
+    // enqueue only, consumers are ordered after it on the same queue
+    CV_Assert(weight.run(1, weightGlobal, nullptr, false));
+}
@@ -2,6 +2,7 @@
 #include <opencv2/core/ocl.hpp>
 
 #include "askier/Dithering.hpp"
+#include "askier/OclProgramCache.hpp"
 
 static std::string fs_kernel_src = R"SRC(
 
@@ -65,12 +66,7 @@ void applyFloydSteinberg(cv::ocl::Context &context, cv::UMat &cells, int levels)
         cells.copyTo(continuous);
     }
 
-    std::string compileErrors;
-    cv::ocl::ProgramSource source(fs_kernel_src);
-    cv::ocl::Program program = context.getProg(source, "", compileErrors);
-    if (program.empty()) {
-        throw std::runtime_error("OpenCL ascii mapper compilaton failed" + compileErrors);
-    }
+    const cv::ocl::Program program = oclProgram(context, fs_kernel_src, "", "Floyd-Steinberg dither");
     cv::ocl::Kernel kernel("floyd_steinberg_serpentine", program);
     CV_Assert(!kernel.empty());
     // Kernel args
@@ -83,6 +79,6 @@ void applyFloydSteinberg(cv::ocl::Context &context, cv::UMat &cells, int levels)
     );
     // Global size: one work-item per row (row-serial, in-row sequential)
     size_t global[1] = {static_cast<size_t>(cells.rows)};
-    const bool ok = kernel.run(1, global, nullptr, true);
+    const bool ok = kernel.run(1, global, nullptr, false);
     CV_Assert(ok);
 }
\ No newline at end of file
@@ -24,13 +24,14 @@ static QString cacheBasePath() {
 }
 
 
-static QString fontKey(const QFont &font) {
-    return font.family() + QString("_%1").arg(font.pointSize());
+QString GlyphDensityCalibrator::fontKey(const QFont &font) {
+    const int pointSize = font.pointSize() > 0 ? font.pointSize() : DEFAULT_FONT_SIZE;
+    return font.family() + QString("_%1").arg(pointSize);
 }
 
 static QString glyphPixmapCachePath(const QFont &font, const QString &glyph, const QString &extension) {
     const auto base = cacheBasePath() + "/pixmaps";
-    const QString key = fontKey(font);
+    const QString key = GlyphDensityCalibrator::fontKey(font);
     QDir().mkpath(base);
     std::string glyphCode = std::to_string(static_cast<int>(glyph.at(0).toLatin1()));
     return base + "/" + ASKIER_VERSION + "_" + key + "_glyph_" + QString::fromStdString(glyphCode) + "_pixmap" + "." +
@@ -41,7 +42,7 @@ static QString glyphPixmapCachePath(const QFont &font, const QString &glyph, con
 static QString cachePathFromFont(const QFont &font) {
     const auto base = cacheBasePath();
 
-    const QString key = fontKey(font);
+    const QString key = GlyphDensityCalibrator::fontKey(font);
     const QString path = base + "/ascii_lut_v" + ASKIER_VERSION + "_" + key + ".json";
     return path;
 }
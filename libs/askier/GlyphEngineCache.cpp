@@ -0,0 +1,169 @@
+#include "askier/GlyphEngineCache.hpp"
+
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <QtConcurrent/QtConcurrent>
+#include <opencv2/core/ocl.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "askier/StructureMatchOCL.hpp"
+
+
+static cv::UMat uploadLut(const GlyphDensityCalibrator &calibrator) {
+    const auto &lut = calibrator.lut();
+    cv::Mat hostLut(1, static_cast<int>(lut.size()), CV_8UC1);
+    for (size_t i = 0; i < lut.size(); i++) {
+        hostLut.at<uchar>(0, static_cast<int>(i)) = lut[i];
+    }
+    return hostLut.getUMat(cv::ACCESS_READ).clone();
+}
+
+static GlyphEngine::ScaledGlyphs buildScaled(const GlyphEngine &engine, const int scale) {
+    QFont font = engine.calibrator->font();
+    font.setPointSize(font.pointSize() * scale);
+    GlyphDensityCalibrator scaledCalibrator(font);
+    scaledCalibrator.ensureCalibrated();
+    // the scaled font's cell is only about scale times as large, glyphs must tile the engine's cells exactly
+    const int sourceWidth = scaledCalibrator.pixmapWidths()[0];
+    const int sourceHeight = scaledCalibrator.pixmapHeights()[0];
+    const size_t sourceArea = static_cast<size_t>(sourceWidth) * sourceHeight;
+    if (scaledCalibrator.pixmaps().size() != ASCII_COUNT * sourceArea) {
+        throw std::runtime_error("Inconsistent pixmaps of the scaled font");
+    }
+    const int width = scale * engine.pixmapWidth;
+    const int height = scale * engine.pixmapHeight;
+    cv::Mat hostPixmaps(1, ASCII_COUNT * width * height, CV_8UC1);
+    for (int i = 0; i < ASCII_COUNT; ++i) {
+        const cv::Mat glyph(sourceHeight, sourceWidth, CV_8UC1,
+                            const_cast<uchar *>(scaledCalibrator.pixmaps().data() + i * sourceArea));
+        cv::Mat target(height, width, CV_8UC1, hostPixmaps.ptr() + static_cast<size_t>(i) * width * height);
+        cv::resize(glyph, target, target.size(), 0, 0, cv::INTER_AREA);
+    }
+    return {uploadLut(scaledCalibrator), hostPixmaps.getUMat(cv::ACCESS_READ).clone()};
+}
+
+std::shared_ptr<const GlyphEngine> GlyphEngine::create(const std::shared_ptr<GlyphDensityCalibrator> &calibrator) {
+    if (calibrator->pixmapHeights().size() != calibrator->pixmapWidths().size()) {
+        throw std::runtime_error("pixmap dimensions not equal");
+    }
+    auto engine = std::make_shared<GlyphEngine>();
+    engine->calibrator = calibrator;
+    engine->pixmapWidth = calibrator->pixmapWidths()[0];
+    engine->pixmapHeight = calibrator->pixmapHeights()[0];
+    for (size_t i = 0; i < calibrator->pixmapHeights().size(); ++i) {
+        if (calibrator->pixmapHeights()[i] != engine->pixmapHeight) {
+            throw std::runtime_error("Inconsistent pixmap heights");
+        }
+        if (calibrator->pixmapWidths()[i] != engine->pixmapWidth) {
+            throw std::runtime_error("Inconsistent pixmap widths");
+        }
+    }
+    engine->deviceLut = uploadLut(*calibrator);
+    const auto &pixmaps = calibrator->pixmaps();
+    cv::Mat hostDensePixmaps(1, static_cast<int>(pixmaps.size()), CV_8UC1);
+    for (size_t i = 0; i < pixmaps.size(); i++) {
+        hostDensePixmaps.at<uchar>(0, static_cast<int>(i)) = pixmaps[i];
+    }
+    engine->deviceDensePixmaps = hostDensePixmaps.getUMat(cv::ACCESS_READ).clone();
+    engine->features = glyph_structure_features(*calibrator);
+    engine->deviceFeatures = engine->features.getUMat(cv::ACCESS_READ).clone();
+    for (const auto [set, target]: {
+             std::pair{GlyphSet::Braille, &engine->deviceBraillePixmaps},
+             std::pair{GlyphSet::Blocks, &engine->deviceBlockPixmaps},
+         }) {
+        std::vector<uint8_t> setPixmaps = renderGlyphSetPixmaps(set, engine->pixmapWidth, engine->pixmapHeight);
+        const cv::Mat hostPixmaps(1, static_cast<int>(setPixmaps.size()), CV_8UC1, setPixmaps.data());
+        *target = hostPixmaps.getUMat(cv::ACCESS_READ).clone();
+    }
+    // the uploads are queued on this thread's queue, pipelines on other threads must not see the engine before
+    cv::ocl::finish();
+    return engine;
+}
+
+const GlyphEngine::ScaledGlyphs &GlyphEngine::scaled(const int scale) const {
+    CV_Assert(scale == 2 || scale == 4);
+    std::call_once(scaledOnce, [this]() {
+        scaled2 = buildScaled(*this, 2);
+        scaled4 = buildScaled(*this, 4);
+        // pipelines of other threads may read them next, like the engine itself after create
+        cv::ocl::finish();
+    });
+    return scale == 2 ? scaled2 : scaled4;
+}
+
+const cv::UMat &GlyphEngine::devicePixmaps(const GlyphSet set) const {
+    switch (set) {
+        case GlyphSet::Braille:
+            return deviceBraillePixmaps;
+        case GlyphSet::Blocks:
+            return deviceBlockPixmaps;
+        case GlyphSet::Ascii:
+        default:
+            return deviceDensePixmaps;
+    }
+}
+
+long long GlyphEngine::bytes() const {
+    // device copies plus the host side calibrator data
+    const auto device = static_cast<long long>(deviceLut.total() + deviceDensePixmaps.total() +
+                                               deviceFeatures.total() * deviceFeatures.elemSize() +
+                                               deviceBraillePixmaps.total() + deviceBlockPixmaps.total());
+    return 2 * device;
+}
+
+GlyphEngineCache::GlyphEngineCache(long long capacityBytes) : capacityBytes(capacityBytes) {
+}
+
+std::shared_ptr<const GlyphEngine> GlyphEngineCache::find(const QFont &font) {
+    const QString key = GlyphDensityCalibrator::fontKey(font);
+    std::lock_guard lock(mutex);
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if (it->key == key) {
+            entries.splice(entries.begin(), entries, it);
+            return entries.front().engine;
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<const GlyphEngine> GlyphEngineCache::get(const QFont &font) {
+    if (auto engine = find(font)) {
+        return engine;
+    }
+    // build outside the lock, concurrent misses of one font may both build
+    auto calibrator = std::make_shared<GlyphDensityCalibrator>(font);
+    calibrator->ensureCalibrated();
+    auto engine = GlyphEngine::create(calibrator);
+    insert(GlyphDensityCalibrator::fontKey(font), engine);
+    return engine;
+}
+
+QFuture<std::shared_ptr<const GlyphEngine>> GlyphEngineCache::getAsync(const QFont &font) {
+    return QtConcurrent::run([this, font]() {
+        return get(font);
+    });
+}
+
+long long GlyphEngineCache::bytes() const {
+    std::lock_guard lock(mutex);
+    return usedBytes;
+}
+
+void GlyphEngineCache::insert(const QString &key, const std::shared_ptr<const GlyphEngine> &engine) {
+    std::lock_guard lock(mutex);
+    std::erase_if(entries, [this, &key](const Entry &entry) {
+        if (entry.key != key) {
+            return false;
+        }
+        usedBytes -= entry.engine->bytes();
+        return true;
+    });
+    entries.push_front({key, engine});
+    usedBytes += engine->bytes();
+    // the most recent engine stays even if it alone exceeds the cap
+    while (usedBytes > capacityBytes && entries.size() > 1) {
+        usedBytes -= entries.back().engine->bytes();
+        entries.pop_back();
+    }
+}
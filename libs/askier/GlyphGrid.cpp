@@ -0,0 +1,54 @@
+#include "askier/GlyphGrid.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+
+GlyphGrid::GlyphGrid(const int columns, const int rows, const size_t stride, const uint8_t *data,
+                     std::shared_ptr<const void> owner, const GlyphSet set)
+    : columns_(columns), rows_(rows), stride_(stride), data_(data), owner(std::move(owner)), set(set) {
+}
+
+GlyphGrid GlyphGrid::copyOf(const int columns, const int rows, const size_t stride, const uint8_t *data,
+                            const GlyphSet set) {
+    const auto bytes = std::make_shared<std::vector<uint8_t> >(static_cast<size_t>(columns) * rows);
+    if (stride == static_cast<size_t>(columns)) {
+        std::memcpy(bytes->data(), data, bytes->size());
+    } else {
+        for (int y = 0; y < rows; ++y) {
+            std::memcpy(bytes->data() + static_cast<size_t>(y) * columns, data + y * stride, columns);
+        }
+    }
+    return {columns, rows, static_cast<size_t>(columns), bytes->data(), bytes, set};
+}
+
+GlyphGrid GlyphGrid::rowRange(const int first, const int count) const {
+    if (first < 0 || count < 0 || first + count > rows_) {
+        throw std::out_of_range("Glyph grid rows out of range");
+    }
+    return {columns_, count, stride_, row(first), owner, set};
+}
+
+std::string GlyphGrid::text() const {
+    if (set == GlyphSet::Ascii) {
+        // ASCII is its own UTF-8 encoding
+        std::string text(static_cast<size_t>(columns_ + 1) * rows_, '\n');
+        for (int y = 0; y < rows_; ++y) {
+            std::memcpy(text.data() + static_cast<size_t>(y) * (columns_ + 1), row(y), columns_);
+        }
+        return text;
+    }
+    // three bytes per character in both bit pattern sets
+    std::string text;
+    text.reserve(static_cast<size_t>(3 * columns_ + 1) * rows_);
+    for (int y = 0; y < rows_; ++y) {
+        const uint8_t *codes = row(y);
+        for (int x = 0; x < columns_; ++x) {
+            appendGlyphUtf8(text, set, codes[x]);
+        }
+        text += '\n';
+    }
+    return text;
+}
@@ -0,0 +1,110 @@
+#include "askier/GlyphHysteresisOCL.hpp"
+#include <askier/Constants.hpp>
+#include <askier/KernelAutotuner.hpp>
+#include <askier/OclProgramCache.hpp>
+#include <askier/ToneRemapOCL.hpp>
+
+#include <opencv2/core/mat.hpp>
+#include <opencv2/core/ocl.hpp>
+
+
+static std::string kernel_source = R"SRC(
+kernel void ascii_map_lut_hysteresis(
+__global const float *src,
+__global const uchar *lut,
+__global uchar *state_index,
+__global float *state_luminance,
+__global uchar *dst,
+int rows,
+int cols,
+int lut_size,
+float margin,
+float smoothing,
+int reset
+#ifdef TONE_REMAP
+, __global const float *remap
+#endif
+)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= cols || y >= rows) {
+        return;
+    }
+    const int idx = y * cols + x;
+    const int max_lut_index = lut_size - 1;
+
+    float luminance = src[idx];
+#ifdef TONE_REMAP
+    // remap sampled at the bin centres, interpolated in between
+    const float position = clamp(luminance, 0.0f, 1.0f) * (TONE_REMAP_BINS - 1);
+    const int bin = min((int) position, TONE_REMAP_BINS - 2);
+    luminance = mix(remap[bin], remap[bin + 1], position - (float) bin);
+#endif
+    if (!reset) {
+        luminance = mix(state_luminance[idx], luminance, smoothing);
+    }
+    // continuous darkness index, the plain mapper rounds it
+    const float target = clamp((1.0f - luminance) * max_lut_index, 0.0f, (float) max_lut_index);
+    int index = (int) round(target);
+    if (!reset) {
+        const int shown = state_index[idx];
+        if (fabs(target - (float) shown) <= 0.5f + margin) {
+            index = shown;
+        }
+    }
+    state_luminance[idx] = luminance;
+    state_index[idx] = (uchar) index;
+    dst[idx] = lut[index];
+}
+)SRC";
+
+cv::UMat ascii_mapper_hysteresis_ocl(cv::ocl::Context &context, const cv::UMat &src,
+                                     const cv::UMat &deviceLut, GlyphHysteresisState &state,
+                                     const float margin, const float smoothing, cv::UMatUsageFlags usage,
+                                     const std::array<size_t, 2> &localSize, const cv::UMat &remap) {
+    CV_Assert(src.type() == CV_32F);
+    CV_Assert(deviceLut.type() == CV_8U);
+    CV_Assert(deviceLut.rows == 1);
+    CV_Assert(deviceLut.cols == ASCII_COUNT);
+    cv::UMat dst(src.size(), CV_8U, usage);
+    if (state.index.size() != src.size()) {
+        state.index.create(src.size(), CV_8U, cv::USAGE_ALLOCATE_DEVICE_MEMORY);
+        state.luminance.create(src.size(), CV_32F, cv::USAGE_ALLOCATE_DEVICE_MEMORY);
+        state.reset = true;
+    }
+
+    const bool remapped = !remap.empty();
+    const cv::ocl::Program program = oclProgram(context, kernel_source,
+                                                remapped ? tone_remap_build_options() : "", "glyph hysteresis");
+    cv::ocl::Kernel kernel("ascii_map_lut_hysteresis", program);
+    CV_Assert(!kernel.empty());
+    CV_Assert(src.isContinuous());
+    CV_Assert(deviceLut.isContinuous());
+    CV_Assert(dst.isContinuous());
+
+    kernel.args(
+        cv::ocl::KernelArg::PtrReadOnly(src),
+        cv::ocl::KernelArg::PtrReadOnly(deviceLut),
+        cv::ocl::KernelArg::PtrReadWrite(state.index),
+        cv::ocl::KernelArg::PtrReadWrite(state.luminance),
+        cv::ocl::KernelArg::PtrWriteOnly(dst),
+        src.rows,
+        src.cols,
+        ASCII_COUNT,
+        margin,
+        smoothing,
+        state.reset ? 1 : 0
+    );
+    if (remapped) {
+        CV_Assert(remap.type() == CV_32F && remap.total() == static_cast<size_t>(TONE_REMAP_BINS));
+        kernel.set(11, cv::ocl::KernelArg::PtrReadOnly(remap));
+    }
+
+    // enqueue only, the next frame's run is ordered after it on the same queue
+    bool run_ok = runKernel2D(kernel, src.cols, src.rows, localSize, false);
+    CV_Assert(run_ok);
+    state.reset = false;
+
+    return dst;
+}
@@ -0,0 +1,119 @@
+#include "askier/GlyphSet.hpp"
+#include <askier/Constants.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+
+// quadrant block elements indexed by their 4-bit pattern
+static constexpr char32_t BLOCK_CODEPOINTS[16] = {
+    // space, quadrant upper left, upper right, upper half
+    0x0020, 0x2598, 0x259D, 0x2580,
+    // lower left, left half, upper right and lower left, all but lower right
+    0x2596, 0x258C, 0x259E, 0x259B,
+    // lower right, upper left and lower right, right half, all but lower left
+    0x2597, 0x259A, 0x2590, 0x259C,
+    // lower half, all but upper right, all but upper left, full block
+    0x2584, 0x2599, 0x259F, 0x2588,
+};
+
+constexpr char32_t BRAILLE_BASE = 0x2800;
+
+/**
+ * Bit of the U+2800 pattern of the dot in column x, row y, see the Unicode
+ * braille patterns block: dots 1-3 and 4-6 run down the columns, 7 and 8
+ * are the bottom row.
+ */
+static int brailleBit(const int x, const int y) {
+    if (y == 3) {
+        return 6 + x;
+    }
+    return 3 * x + y;
+}
+
+SubCellLayout glyphSetLayout(const GlyphSet set) {
+    switch (set) {
+        case GlyphSet::Braille:
+            return {2, 4};
+        case GlyphSet::Blocks:
+            return {2, 2};
+        case GlyphSet::Ascii:
+        default:
+            return {1, 1};
+    }
+}
+
+int glyphSetCodeCount(const GlyphSet set) {
+    switch (set) {
+        case GlyphSet::Braille:
+            return 256;
+        case GlyphSet::Blocks:
+            return 16;
+        case GlyphSet::Ascii:
+        default:
+            return ASCII_COUNT;
+    }
+}
+
+char32_t glyphCodepoint(const GlyphSet set, const uint8_t code) {
+    switch (set) {
+        case GlyphSet::Braille:
+            return BRAILLE_BASE + code;
+        case GlyphSet::Blocks:
+            return code < 16 ? BLOCK_CODEPOINTS[code] : U' ';
+        case GlyphSet::Ascii:
+        default:
+            // control codes would corrupt terminals
+            return code < ASCII_MIN || code > ASCII_MAX ? U' ' : static_cast<char32_t>(code);
+    }
+}
+
+void appendGlyphUtf8(std::string &out, const GlyphSet set, const uint8_t code) {
+    const char32_t codepoint = glyphCodepoint(set, code);
+    if (codepoint < 0x80) {
+        out += static_cast<char>(codepoint);
+    } else if (codepoint < 0x800) {
+        out += static_cast<char>(0xC0 | codepoint >> 6);
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    } else {
+        // both sets lie in the basic multilingual plane
+        out += static_cast<char>(0xE0 | codepoint >> 12);
+        out += static_cast<char>(0x80 | (codepoint >> 6 & 0x3F));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+}
+
+std::vector<uint8_t> renderGlyphSetPixmaps(const GlyphSet set, const int cellWidth, const int cellHeight) {
+    if (set == GlyphSet::Ascii) {
+        return {};
+    }
+    const auto [columns, rows] = glyphSetLayout(set);
+    const int count = glyphSetCodeCount(set);
+    const size_t area = static_cast<size_t>(cellWidth) * cellHeight;
+    std::vector<uint8_t> pixmaps(area * count, 255);
+    const double subWidth = static_cast<double>(cellWidth) / columns;
+    const double subHeight = static_cast<double>(cellHeight) / rows;
+    // braille dots are discs leaving a gap to their neighbours, blocks fill their quadrant
+    const double radius = 0.35 * std::min(subWidth, subHeight);
+    for (int code = 0; code < count; ++code) {
+        uint8_t *pixmap = pixmaps.data() + area * code;
+        for (int py = 0; py < cellHeight; ++py) {
+            const int y = std::min(rows - 1, static_cast<int>(py / subHeight));
+            for (int px = 0; px < cellWidth; ++px) {
+                const int x = std::min(columns - 1, static_cast<int>(px / subWidth));
+                bool ink;
+                if (set == GlyphSet::Braille) {
+                    const double dx = px + 0.5 - (x + 0.5) * subWidth;
+                    const double dy = py + 0.5 - (y + 0.5) * subHeight;
+                    ink = (code >> brailleBit(x, y) & 1) && dx * dx + dy * dy <= radius * radius;
+                } else {
+                    ink = code >> (y * columns + x) & 1;
+                }
+                if (ink) {
+                    pixmap[static_cast<size_t>(py) * cellWidth + px] = 0;
+                }
+            }
+        }
+    }
+    return pixmaps;
+}
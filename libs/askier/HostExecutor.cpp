@@ -0,0 +1,128 @@
+#include "askier/HostExecutor.hpp"
+#include <askier/Constants.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <oneapi/tbb/blocked_range.h>
+#include <oneapi/tbb/parallel_for.h>
+#include <oneapi/tbb/task_scheduler_observer.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+/**
+ * Accounts the time threads spend in the arena and pins its workers. Workers
+ * are shared between arenas, so their previous affinity is restored on exit.
+ */
+class HostExecutor::Observer final : public tbb::task_scheduler_observer {
+public:
+    Observer(tbb::task_arena &arena, std::atomic<int64_t> &busyNs, const std::vector<int> &cpus)
+        : tbb::task_scheduler_observer(arena), busyNs(busyNs) {
+#ifdef __linux__
+        CPU_ZERO(&pinned);
+        for (const int cpu: cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &pinned);
+                pin = true;
+            }
+        }
+#else
+        static_cast<void>(cpus);
+#endif
+        observe(true);
+    }
+
+    ~Observer() override {
+        observe(false);
+    }
+
+    void on_scheduler_entry(const bool worker) override {
+        Entry entry{std::chrono::steady_clock::now()};
+#ifdef __linux__
+        if (worker && pin) {
+            entry.restore = pthread_getaffinity_np(pthread_self(), sizeof(entry.affinity), &entry.affinity) == 0 &&
+                            pthread_setaffinity_np(pthread_self(), sizeof(pinned), &pinned) == 0;
+        }
+#else
+        static_cast<void>(worker);
+#endif
+        entries.push_back(entry);
+    }
+
+    void on_scheduler_exit(bool) override {
+        if (entries.empty()) {
+            return;
+        }
+        const Entry entry = entries.back();
+        entries.pop_back();
+#ifdef __linux__
+        if (entry.restore) {
+            pthread_setaffinity_np(pthread_self(), sizeof(entry.affinity), &entry.affinity);
+        }
+#endif
+        busyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - entry.time).count();
+    }
+
+private:
+    struct Entry {
+        std::chrono::steady_clock::time_point time;
+#ifdef __linux__
+        cpu_set_t affinity{};
+        bool restore = false;
+#endif
+    };
+
+    std::atomic<int64_t> &busyNs;
+    // arenas nest, entries and exits of a thread pair up like brackets
+    static thread_local std::vector<Entry> entries;
+#ifdef __linux__
+    cpu_set_t pinned{};
+    bool pin = false;
+#endif
+};
+
+thread_local std::vector<HostExecutor::Observer::Entry> HostExecutor::Observer::entries;
+
+HostExecutor::HostExecutor(const HostExecutorConfig &config)
+    : arena(config.threads > 0 ? config.threads : static_cast<int>(tbb::task_arena::automatic)) {
+    arena.initialize();
+    concurrency = std::max(1, arena.max_concurrency());
+    observer = std::make_unique<Observer>(arena, busyNs, config.cpus);
+}
+
+HostExecutor::~HostExecutor() {
+    // stop observing before the counters go away
+    observer.reset();
+}
+
+void HostExecutor::parallelCopy(void *destination, const void *source, const size_t bytes) {
+    if (static_cast<long long>(bytes) < HOST_PARALLEL_COPY_BYTES || concurrency == 1) {
+        std::memcpy(destination, source, bytes);
+        return;
+    }
+    const size_t chunk = (bytes + concurrency - 1) / concurrency;
+    arena.execute([&] {
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, bytes, chunk),
+                          [destination, source](const tbb::blocked_range<size_t> &range) {
+                              std::memcpy(static_cast<char *>(destination) + range.begin(),
+                                          static_cast<const char *>(source) + range.begin(), range.size());
+                          });
+    });
+}
+
+double HostExecutor::utilization() const {
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - since).count();
+    if (elapsed <= 0) {
+        return 0.0;
+    }
+    return std::min(1.0, static_cast<double>(busyNs.load()) / (static_cast<double>(elapsed) * concurrency));
+}
+
+void HostExecutor::resetUtilization() {
+    busyNs = 0;
+    since = std::chrono::steady_clock::now();
+}
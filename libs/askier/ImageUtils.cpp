@@ -1,14 +1,31 @@
 #include "askier/ImageUtils.hpp"
 
+#include <algorithm>
+#include <QImageReader>
+#include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "askier/Constants.hpp"
+
+
+static void releaseImageOwner(void *owner) {
+    delete static_cast<std::shared_ptr<const void> *>(owner);
+}
+
+QImage wrapInQImage(const std::shared_ptr<const void> &owner, const uchar *data, int width, int height,
+                    qsizetype bytesPerLine, QImage::Format format) {
+    // the const data constructor makes writers detach instead of touching data
+    return QImage(data, width, height, bytesPerLine, format, releaseImageOwner,
+                  new std::shared_ptr<const void>(owner));
+}
 
 QImage matToQImage(const cv::Mat &bgr) {
     if (bgr.empty()) {
         return QImage();
     }
 
-    return QImage(bgr.data, bgr.cols, bgr.rows, bgr.step, QImage::Format_BGR888).copy();
+    return wrapInQImage(std::make_shared<const cv::Mat>(bgr), bgr.data, bgr.cols, bgr.rows, bgr.step,
+                        QImage::Format_BGR888);
 }
 
 QImage matToQImageGray(const cv::Mat &gray) {
@@ -16,5 +33,75 @@ QImage matToQImageGray(const cv::Mat &gray) {
         return QImage();
     }
 
-    return QImage(gray.data, gray.cols, gray.rows, gray.step, QImage::Format_Grayscale8).copy();
-}
\ No newline at end of file
+    return wrapInQImage(std::make_shared<const cv::Mat>(gray), gray.data, gray.cols, gray.rows, gray.step,
+                        QImage::Format_Grayscale8);
+}
+
+int reducedDecodeFactor(const cv::Size &sourceSize, int columns, double cellAspect, const SubCellLayout &samples) {
+    if (sourceSize.empty() || columns <= 0 || cellAspect <= 0.0) {
+        return 1;
+    }
+    // rows follow from columns the same way AsciiPipeline derives them
+    const double rows = static_cast<double>(sourceSize.height) / sourceSize.width * columns / cellAspect;
+    // never decode below the grid the pipeline resamples to
+    const int minColumnPixels = std::max(MIN_SOURCE_PIXELS_PER_CELL, samples.columns);
+    const int minRowPixels = std::max(MIN_SOURCE_PIXELS_PER_CELL, samples.rows);
+    for (const int factor: {8, 4, 2}) {
+        const double pixelsPerColumn = static_cast<double>(sourceSize.width) / factor / columns;
+        const double pixelsPerRow = static_cast<double>(sourceSize.height) / factor / std::max(1.0, rows);
+        if (pixelsPerColumn >= minColumnPixels && pixelsPerRow >= minRowPixels) {
+            return factor;
+        }
+    }
+    return 1;
+}
+
+cv::Mat loadReducedImage(const QString &path, int factor, bool grayscale) {
+    int flags = grayscale ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR;
+    switch (factor) {
+        case 2:
+            flags = grayscale ? cv::IMREAD_REDUCED_GRAYSCALE_2 : cv::IMREAD_REDUCED_COLOR_2;
+            break;
+        case 4:
+            flags = grayscale ? cv::IMREAD_REDUCED_GRAYSCALE_4 : cv::IMREAD_REDUCED_COLOR_4;
+            break;
+        case 8:
+            flags = grayscale ? cv::IMREAD_REDUCED_GRAYSCALE_8 : cv::IMREAD_REDUCED_COLOR_8;
+            break;
+        default:
+            break;
+    }
+    return cv::imread(path.toStdString(), flags);
+}
+
+cv::Mat loadImageForColumns(const QString &path, int columns, double cellAspect, const SubCellLayout &samples,
+                            bool grayscale, int *factor, cv::Size *sourceSize) {
+    // QImageReader only parses the header here, nothing is decoded
+    QImageReader reader(path);
+    QSize headerSize = reader.size();
+    // cv::imread applies the EXIF orientation, so the factor is chosen for the oriented size
+    if (reader.transformation().testFlag(QImageIOHandler::TransformationRotate90)) {
+        headerSize.transpose();
+    }
+    int reduction = 1;
+    cv::Size size;
+    if (headerSize.isValid()) {
+        size = cv::Size(headerSize.width(), headerSize.height());
+        reduction = reducedDecodeFactor(size, columns, cellAspect, samples);
+    }
+    cv::Mat image = loadReducedImage(path, reduction, grayscale);
+    if (image.empty() && reduction != 1) {
+        reduction = 1;
+        image = loadReducedImage(path, reduction, grayscale);
+    }
+    if (size.empty() || reduction == 1) {
+        size = image.size();
+    }
+    if (factor != nullptr) {
+        *factor = reduction;
+    }
+    if (sourceSize != nullptr) {
+        *sourceSize = size;
+    }
+    return image;
+}
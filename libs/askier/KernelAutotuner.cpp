@@ -0,0 +1,227 @@
+#include "askier/KernelAutotuner.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <vector>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <opencv2/core.hpp>
+
+#include "askier/ASCIIDrawGlyphsOCL.hpp"
+#include "askier/AsciimapOCL.hpp"
+#include "askier/Constants.hpp"
+#include "askier/version.hpp"
+
+// benchmark frame, the default camera columns at a 16:9 aspect
+constexpr int BENCHMARK_COLUMNS = 480;
+constexpr int BENCHMARK_ROWS = 135;
+constexpr int BENCHMARK_RUNS = 5;
+
+static const std::vector<std::array<size_t, 2> > LOCAL_SIZE_CANDIDATES = {
+    {0, 0}, {8, 8}, {16, 8}, {16, 16}, {32, 8}, {64, 4},
+};
+
+static const std::vector<GlyphDrawVariant> DRAW_VARIANTS = {
+    GlyphDrawVariant::PerCell,
+    GlyphDrawVariant::PerCellVector,
+    GlyphDrawVariant::PerPixel,
+    GlyphDrawVariant::PerPixelLocalAtlas,
+};
+
+static size_t roundUp(const size_t value, const size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+bool runKernel2D(cv::ocl::Kernel &kernel, size_t cols, size_t rows, const std::array<size_t, 2> &localSize,
+                 bool sync) {
+    // sizes tuned on one kernel may exceed the limit of another, e.g. one using more registers or local memory
+    if (localSize[0] == 0 || localSize[1] == 0 || localSize[0] * localSize[1] > kernel.workGroupSize()) {
+        size_t globals[2] = {cols, rows};
+        return kernel.run(2, globals, nullptr, sync);
+    }
+    size_t globals[2] = {roundUp(cols, localSize[0]), roundUp(rows, localSize[1])};
+    size_t locals[2] = {localSize[0], localSize[1]};
+    return kernel.run(2, globals, locals, sync);
+}
+
+static QString tuningCachePath() {
+    const QString base = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(base);
+    return base + "/kernel_tuning_v" + ASKIER_VERSION + ".json";
+}
+
+static QJsonObject loadTuningCache() {
+    QFile file(tuningCachePath());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return {};
+    }
+    const auto doc = QJsonDocument::fromJson(file.readAll());
+    return doc.isObject() ? doc.object() : QJsonObject();
+}
+
+static QJsonArray toJson(const std::array<size_t, 2> &size) {
+    return QJsonArray{static_cast<qint64>(size[0]), static_cast<qint64>(size[1])};
+}
+
+static std::array<size_t, 2> localSizeFromJson(const QJsonValue &value) {
+    const auto arr = value.toArray();
+    if (arr.size() != 2) {
+        return {0, 0};
+    }
+    return {static_cast<size_t>(arr[0].toInteger()), static_cast<size_t>(arr[1].toInteger())};
+}
+
+/**
+ * Whether a configuration read from the cache can run on the device, the file
+ * may have been edited or written by another build
+ */
+static bool validConfig(const cv::ocl::Context &context, const KernelLaunchConfig &config) {
+    if (std::find(DRAW_VARIANTS.begin(), DRAW_VARIANTS.end(), config.drawVariant) == DRAW_VARIANTS.end()) {
+        return false;
+    }
+    const size_t maxWorkGroupSize = context.device(0).maxWorkGroupSize();
+    for (const auto &size: {config.drawLocalSize, config.mapLocalSize}) {
+        // negative entries wrap to huge sizes, checked per side before the product can overflow
+        if (size[0] > maxWorkGroupSize || size[1] > maxWorkGroupSize || size[0] * size[1] > maxWorkGroupSize) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Best of BENCHMARK_RUNS runs after a warm up run, which also builds the
+ * program. Infinity if the configuration fails to launch.
+ */
+template<typename F>
+static double bestSeconds(F &&run) {
+    try {
+        run();
+        cv::ocl::finish();
+        double best = std::numeric_limits<double>::infinity();
+        for (int i = 0; i < BENCHMARK_RUNS; ++i) {
+            const auto start = cv::getTickCount();
+            run();
+            cv::ocl::finish();
+            best = std::min(best, static_cast<double>(cv::getTickCount() - start) / cv::getTickFrequency());
+        }
+        return best;
+    } catch (const cv::Exception &) {
+        // e.g. a work-group size the kernel cannot run with
+        return std::numeric_limits<double>::infinity();
+    }
+}
+
+QString KernelAutotuner::deviceKey(const cv::ocl::Context &context) {
+    const cv::ocl::Device &device = context.device(0);
+    return QString::fromStdString(device.name() + "|" + device.driverVersion());
+}
+
+bool KernelAutotuner::supported(const cv::ocl::Context &context, const GlyphDrawVariant variant,
+                                const GlyphEngine &engine) {
+    if (variant != GlyphDrawVariant::PerPixelLocalAtlas) {
+        return true;
+    }
+    return engine.deviceDensePixmaps.total() <= context.device(0).localMemSize();
+}
+
+KernelLaunchConfig KernelAutotuner::tuned(cv::ocl::Context &context, const GlyphEngine &engine) {
+    const QString key = deviceKey(context);
+    auto cache = loadTuningCache();
+    KernelLaunchConfig config;
+    bool cached = false;
+    if (cache.contains(key)) {
+        const auto obj = cache.value(key).toObject();
+        config.drawVariant = static_cast<GlyphDrawVariant>(obj.value("draw_variant").toInt());
+        config.drawLocalSize = localSizeFromJson(obj.value("draw_local"));
+        config.mapLocalSize = localSizeFromJson(obj.value("map_local"));
+        cached = validConfig(context, config);
+    }
+    if (!cached) {
+        config = benchmark(context, engine);
+        QJsonObject obj;
+        obj.insert("draw_variant", static_cast<int>(config.drawVariant));
+        obj.insert("draw_local", toJson(config.drawLocalSize));
+        obj.insert("map_local", toJson(config.mapLocalSize));
+        cache.insert(key, obj);
+        // written aside and renamed, concurrent processes never read a truncated cache
+        QSaveFile file(tuningCachePath());
+        if (file.open(QIODevice::WriteOnly)) {
+            file.write(QJsonDocument(cache).toJson());
+            file.commit();
+        }
+    }
+    // the atlas of a larger font may not fit local memory
+    if (!supported(context, config.drawVariant, engine)) {
+        config.drawVariant = GlyphDrawVariant::PerPixel;
+        config.drawLocalSize = {0, 0};
+    }
+    return config;
+}
+
+KernelLaunchConfig KernelAutotuner::benchmark(cv::ocl::Context &context, const GlyphEngine &engine) {
+    const size_t maxWorkGroupSize = context.device(0).maxWorkGroupSize();
+    std::vector<std::array<size_t, 2> > localSizes;
+    for (const auto &size: LOCAL_SIZE_CANDIDATES) {
+        if (size[0] * size[1] <= maxWorkGroupSize) {
+            localSizes.push_back(size);
+        }
+    }
+
+    cv::Mat hostGlyphs(BENCHMARK_ROWS, BENCHMARK_COLUMNS, CV_8UC1);
+    cv::randu(hostGlyphs, ASCII_MIN, ASCII_MAX + 1);
+    cv::UMat glyphs;
+    hostGlyphs.copyTo(glyphs);
+    cv::Mat hostCells(BENCHMARK_ROWS, BENCHMARK_COLUMNS, CV_32F);
+    cv::randu(hostCells, 0.0f, 1.0f);
+    cv::UMat cells;
+    hostCells.copyTo(cells);
+
+    KernelLaunchConfig config;
+    double bestMap = std::numeric_limits<double>::infinity();
+    for (const auto &localSize: localSizes) {
+        const double seconds = bestSeconds([&]() {
+            static_cast<void>(ascii_mapper_ocl(context, cells, engine.deviceLut, cv::USAGE_ALLOCATE_DEVICE_MEMORY,
+                                               localSize));
+        });
+        if (seconds < bestMap) {
+            bestMap = seconds;
+            config.mapLocalSize = localSize;
+        }
+    }
+
+    double bestDraw = std::numeric_limits<double>::infinity();
+    for (const auto variant: DRAW_VARIANTS) {
+        if (!supported(context, variant, engine)) {
+            continue;
+        }
+        for (const auto &localSize: localSizes) {
+            KernelLaunchConfig candidate = config;
+            candidate.drawVariant = variant;
+            candidate.drawLocalSize = localSize;
+            const double seconds = bestSeconds([&]() {
+                static_cast<void>(ascii_draw_glyphs_ocl(context, glyphs, engine.deviceDensePixmaps,
+                                                        engine.pixmapWidth, engine.pixmapHeight,
+                                                        engine.pixmapWidth, engine.pixmapHeight,
+                                                        cv::USAGE_ALLOCATE_DEVICE_MEMORY, candidate));
+            });
+            if (seconds < bestDraw) {
+                bestDraw = seconds;
+                config.drawVariant = candidate.drawVariant;
+                config.drawLocalSize = candidate.drawLocalSize;
+            }
+        }
+    }
+    // stdout may carry the converted text
+    std::cerr << "Kernel tuning: draw variant " << static_cast<int>(config.drawVariant) << " local "
+            << config.drawLocalSize[0] << "x" << config.drawLocalSize[1] << " (" << bestDraw * 1000.0
+            << "ms), map local " << config.mapLocalSize[0] << "x" << config.mapLocalSize[1] << " ("
+            << bestMap * 1000.0 << "ms)" << std::endl;
+    return config;
+}
@@ -0,0 +1,49 @@
+#include "askier/MotionGate.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <opencv2/imgproc.hpp>
+
+MotionGate::MotionGate(const double threshold) : maxChange(threshold) {
+}
+
+void MotionGate::setThreshold(const double threshold) {
+    maxChange = threshold;
+    reset();
+}
+
+void MotionGate::reset() {
+    reference.release();
+}
+
+bool MotionGate::changed(const cv::Mat &bgr) {
+    ++frameCount;
+    cut = false;
+    if (bgr.empty()) {
+        return true;
+    }
+    const int width = std::min(MOTION_SIGNATURE_WIDTH, bgr.cols);
+    const int height = std::max(1, static_cast<int>(std::lround(static_cast<double>(bgr.rows) * width / bgr.cols)));
+    // the few signature cells are converted to gray, not the frame
+    cv::resize(bgr, small, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+    if (small.channels() == 3) {
+        cv::cvtColor(small, signature, cv::COLOR_BGR2GRAY);
+    } else {
+        small.copyTo(signature);
+    }
+    if (reference.empty() || reference.size() != signature.size()) {
+        std::swap(reference, signature);
+        return true;
+    }
+    if (enabled() && cv::norm(signature, reference, cv::NORM_INF) <= maxChange) {
+        ++skippedCount;
+        return false;
+    }
+    cut = cv::norm(signature, reference, cv::NORM_L1) / static_cast<double>(signature.total()) > SCENE_CUT_THRESHOLD;
+    std::swap(reference, signature);
+    return true;
+}
+
+double MotionGate::hitRate() const {
+    return frameCount > 0 ? static_cast<double>(skippedCount) / static_cast<double>(frameCount) : 0.0;
+}
@@ -0,0 +1,156 @@
+#include "askier/MultiStreamEngine.hpp"
+
+#include <algorithm>
+
+
+static double msBetween(const std::chrono::steady_clock::time_point &from,
+                        const std::chrono::steady_clock::time_point &to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+static double smoothed(const double average, const double sample, const bool first) {
+    return first ? sample : average + MULTI_STREAM_STATS_SMOOTHING * (sample - average);
+}
+
+MultiStreamEngine::MultiStreamEngine(const std::shared_ptr<const GlyphEngine> &engine,
+                                     const HostExecutorConfig &hostConfig, const int maxBatchFrames)
+    : pipeline_(engine, hostConfig), maxBatchFrames(std::max(1, maxBatchFrames)) {
+}
+
+MultiStreamEngine::StreamId MultiStreamEngine::addStream(const AsciiParams &params) {
+    std::lock_guard lock(mutex);
+    const StreamId id = nextId++;
+    const auto stream = std::make_shared<Stream>();
+    stream->params = params;
+    streams_.emplace(id, stream);
+    return id;
+}
+
+void MultiStreamEngine::removeStream(const StreamId stream) {
+    std::lock_guard lock(mutex);
+    streams_.erase(stream);
+}
+
+void MultiStreamEngine::setParams(const StreamId stream, const AsciiParams &params) {
+    std::lock_guard lock(mutex);
+    streams_.at(stream)->params = params;
+}
+
+void MultiStreamEngine::push(const StreamId stream, const cv::Mat &bgr) {
+    std::lock_guard lock(mutex);
+    Stream &target = *streams_.at(stream);
+    if (!target.pending.empty()) {
+        ++target.stats.dropped;
+    }
+    target.pending = bgr;
+    target.pushed = std::chrono::steady_clock::now();
+}
+
+std::vector<MultiStreamEngine::StreamResult> MultiStreamEngine::step() {
+    struct Taken {
+        StreamId id;
+        std::shared_ptr<Stream> stream;
+        cv::Mat frame;
+        AsciiParams params;
+        std::chrono::steady_clock::time_point pushed;
+    };
+    std::vector<Taken> taken;
+    {
+        std::lock_guard lock(mutex);
+        // round robin: one frame per stream, starting after the last one served
+        auto it = streams_.lower_bound(nextTurn);
+        for (size_t visited = 0; visited < streams_.size() && static_cast<int>(taken.size()) < maxBatchFrames;
+             ++visited, ++it) {
+            if (it == streams_.end()) {
+                it = streams_.begin();
+            }
+            Stream &stream = *it->second;
+            if (stream.pending.empty()) {
+                continue;
+            }
+            taken.push_back({it->first, it->second, stream.pending, stream.params, stream.pushed});
+            stream.pending.release();
+            nextTurn = it->first + 1;
+        }
+    }
+    if (taken.empty()) {
+        return {};
+    }
+
+    std::vector<AsciiPipeline::BatchFrame> frames;
+    frames.reserve(taken.size());
+    for (const auto &[id, stream, frame, params, pushed]: taken) {
+        // the device state of other settings does not carry over
+        if (stream->convertedParams != params) {
+            stream->normalization.reset = true;
+            stream->tone.reset = true;
+            stream->convertedParams = params;
+        }
+        frames.push_back({frame, params, &stream->normalization, &stream->tone});
+    }
+    std::vector<AsciiPipeline::Result> results = pipeline_.processBatch(frames);
+
+    const auto now = std::chrono::steady_clock::now();
+    std::vector<StreamResult> streamResults;
+    streamResults.reserve(taken.size());
+    std::lock_guard lock(mutex);
+    for (size_t i = 0; i < taken.size(); ++i) {
+        Stream &stream = *taken[i].stream;
+        StreamStats &stats = stream.stats;
+        const bool first = stats.frames == 0;
+        stats.latencyMs = smoothed(stats.latencyMs, msBetween(taken[i].pushed, now), first);
+        if (!first) {
+            const double intervalMs = msBetween(stream.lastResult, now);
+            if (intervalMs > 0.0) {
+                stats.fps = smoothed(stats.fps, 1000.0 / intervalMs, stats.fps == 0.0);
+            }
+        }
+        stream.lastResult = now;
+        ++stats.frames;
+        completed.push_back(now);
+        streamResults.push_back({taken[i].id, std::move(results[i])});
+    }
+    if (!firstResult) {
+        firstResult = now;
+    }
+    pruneCompleted(now);
+    return streamResults;
+}
+
+bool MultiStreamEngine::hasPending() const {
+    std::lock_guard lock(mutex);
+    return std::ranges::any_of(streams_, [](const auto &entry) { return !entry.second->pending.empty(); });
+}
+
+MultiStreamEngine::StreamStats MultiStreamEngine::stats(const StreamId stream) const {
+    std::lock_guard lock(mutex);
+    return streams_.at(stream)->stats;
+}
+
+double MultiStreamEngine::throughput() const {
+    std::lock_guard lock(mutex);
+    if (!firstResult) {
+        return 0.0;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    pruneCompleted(now);
+    // streams that ended or stalled stop counting once their frames leave the window
+    const double windowMs = std::min(MULTI_STREAM_THROUGHPUT_WINDOW_MS, msBetween(*firstResult, now));
+    return windowMs > 0.0 ? 1000.0 * static_cast<double>(completed.size()) / windowMs : 0.0;
+}
+
+void MultiStreamEngine::pruneCompleted(const std::chrono::steady_clock::time_point &now) const {
+    while (!completed.empty() && msBetween(completed.front(), now) > MULTI_STREAM_THROUGHPUT_WINDOW_MS) {
+        completed.pop_front();
+    }
+}
+
+std::vector<MultiStreamEngine::StreamId> MultiStreamEngine::streams() const {
+    std::lock_guard lock(mutex);
+    std::vector<StreamId> ids;
+    ids.reserve(streams_.size());
+    for (const auto &[id, stream]: streams_) {
+        ids.push_back(id);
+    }
+    return ids;
+}
@@ -0,0 +1,139 @@
+#include "askier/OclAsync.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <opencv2/core/ocl.hpp>
+
+
+PinnedHostBuffer::~PinnedHostBuffer() {
+    release();
+}
+
+PinnedHostBuffer::PinnedHostBuffer(PinnedHostBuffer &&other) noexcept
+    : buffer(std::move(other.buffer)), queue(std::move(other.queue)),
+      mapped(std::exchange(other.mapped, nullptr)), bytes(std::exchange(other.bytes, 0)) {
+}
+
+PinnedHostBuffer &PinnedHostBuffer::operator=(PinnedHostBuffer &&other) noexcept {
+    if (this != &other) {
+        release();
+        buffer = std::move(other.buffer);
+        queue = std::move(other.queue);
+        mapped = std::exchange(other.mapped, nullptr);
+        bytes = std::exchange(other.bytes, 0);
+    }
+    return *this;
+}
+
+void PinnedHostBuffer::reserve(const cl::Context &context, const cl::CommandQueue &queue, size_t bytes) {
+    if (bytes <= this->bytes) {
+        return;
+    }
+    release();
+    cl_int err = CL_SUCCESS;
+    buffer = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes, nullptr, &err);
+    if (err != CL_SUCCESS) {
+        throw std::runtime_error("Failed to allocate pinned host buffer: " + std::to_string(err));
+    }
+    mapped = queue.enqueueMapBuffer(buffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, bytes, nullptr, nullptr, &err);
+    if (err != CL_SUCCESS) {
+        throw std::runtime_error("Failed to map pinned host buffer: " + std::to_string(err));
+    }
+    this->queue = queue;
+    this->bytes = bytes;
+}
+
+void PinnedHostBuffer::release() {
+    if (mapped != nullptr) {
+        queue.enqueueUnmapMemObject(buffer, mapped);
+        queue.finish();
+    }
+    mapped = nullptr;
+    bytes = 0;
+    buffer = cl::Buffer();
+}
+
+cl::Context oclDefaultContext() {
+    return cl::Context(static_cast<cl_context>(cv::ocl::Context::getDefault().ptr()), true);
+}
+
+cl::Device oclDefaultDevice() {
+    return cl::Device(static_cast<cl_device_id>(cv::ocl::Device::getDefault().ptr()), true);
+}
+
+cl::CommandQueue oclDefaultQueue() {
+    return cl::CommandQueue(static_cast<cl_command_queue>(cv::ocl::Queue::getDefault().ptr()), true);
+}
+
+cl::Event markDefaultQueue() {
+    const auto queue = oclDefaultQueue();
+    cl::Event event;
+    queue.enqueueMarkerWithWaitList(nullptr, &event);
+    queue.flush();
+    return event;
+}
+
+void waitOnDefaultQueue(const cl::Event &event) {
+    const std::vector<cl::Event> events{event};
+    oclDefaultQueue().enqueueBarrierWithWaitList(&events);
+}
+
+cl::Event enqueueReadUMat(const cl::CommandQueue &queue, const cv::UMat &src, void *dst,
+                          const std::vector<cl::Event> &waitFor) {
+    CV_Assert(src.isContinuous());
+    const cl::Buffer buffer(static_cast<cl_mem>(src.handle(cv::ACCESS_READ)), true);
+    cl::Event event;
+    const cl_int err = queue.enqueueReadBuffer(buffer, CL_FALSE, src.offset, src.total() * src.elemSize(), dst,
+                                               waitFor.empty() ? nullptr : &waitFor, &event);
+    if (err != CL_SUCCESS) {
+        throw std::runtime_error("Failed to enqueue device read: " + std::to_string(err));
+    }
+    return event;
+}
+
+cl::Event enqueueWriteUMat(const cl::CommandQueue &queue, cv::UMat &dst, const void *src,
+                           const std::vector<cl::Event> &waitFor) {
+    CV_Assert(dst.isContinuous());
+    const cl::Buffer buffer(static_cast<cl_mem>(dst.handle(cv::ACCESS_WRITE)), true);
+    cl::Event event;
+    const cl_int err = queue.enqueueWriteBuffer(buffer, CL_FALSE, dst.offset, dst.total() * dst.elemSize(), src,
+                                                waitFor.empty() ? nullptr : &waitFor, &event);
+    if (err != CL_SUCCESS) {
+        throw std::runtime_error("Failed to enqueue device write: " + std::to_string(err));
+    }
+    return event;
+}
+
+MappedUMat::~MappedUMat() {
+    if (data == nullptr) {
+        return;
+    }
+    // wait for the unmap before the buffer can return to OpenCV's pool
+    cl::Event unmapped;
+    ready.wait();
+    queue.enqueueUnmapMemObject(buffer, data, nullptr, &unmapped);
+    unmapped.wait();
+}
+
+std::shared_ptr<MappedUMat> enqueueMapUMat(const cl::CommandQueue &queue, const cv::UMat &src,
+                                           const std::vector<cl::Event> &waitFor) {
+    CV_Assert(src.isContinuous());
+    auto mapped = std::make_shared<MappedUMat>();
+    mapped->umat = src;
+    mapped->queue = queue;
+    mapped->buffer = cl::Buffer(static_cast<cl_mem>(src.handle(cv::ACCESS_READ)), true);
+    cl_int err = CL_SUCCESS;
+    mapped->data = queue.enqueueMapBuffer(mapped->buffer, CL_FALSE, CL_MAP_READ, src.offset,
+                                          src.total() * src.elemSize(), waitFor.empty() ? nullptr : &waitFor,
+                                          &mapped->ready, &err);
+    if (err != CL_SUCCESS) {
+        mapped->data = nullptr;
+        throw std::runtime_error("Failed to enqueue device map: " + std::to_string(err));
+    }
+    return mapped;
+}
+
+bool oclHostUnifiedMemory() {
+    return cv::ocl::Device::getDefault().hostUnifiedMemory();
+}
@@ -0,0 +1,107 @@
+#include "askier/OclProgramCache.hpp"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+
+namespace {
+    struct CachedProgram {
+        cv::ocl::Program program;
+        // a binary program source refers to the bytes it was created from
+        std::vector<char> binary;
+    };
+}
+
+static std::mutex mutex;
+// by context handle, the program keeps its context and thereby the handle alive
+static std::map<std::tuple<void *, uint64_t>, std::shared_ptr<const CachedProgram> > programs;
+
+static uint64_t fnv1a(uint64_t hash, const std::string &bytes) {
+    for (const char byte: bytes) {
+        hash ^= static_cast<uint8_t>(byte);
+        hash *= 1099511628211ULL;
+    }
+    // separates the fields
+    return (hash ^ 0xff) * 1099511628211ULL;
+}
+
+static QString binaryPath(const uint64_t key) {
+    const QString base = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/kernels";
+    QDir().mkpath(base);
+    return base + QString("/%1.bin").arg(key, 16, 16, QChar('0'));
+}
+
+static std::shared_ptr<CachedProgram> loadBinary(cv::ocl::Context &context, const QString &path,
+                                                 const std::string &options) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return nullptr;
+    }
+    const QByteArray bytes = file.readAll();
+    if (bytes.isEmpty()) {
+        return nullptr;
+    }
+    auto cached = std::make_shared<CachedProgram>();
+    cached->binary.assign(bytes.begin(), bytes.end());
+    const auto source = cv::ocl::ProgramSource::fromBinary(
+        "askier", QFileInfo(path).baseName().toStdString(),
+        reinterpret_cast<const uchar *>(cached->binary.data()), cached->binary.size());
+    std::string buildErrors;
+    cached->program = context.getProg(source, options, buildErrors);
+    // a binary the driver rejects is compiled again and replaced
+    return cached->program.empty() ? nullptr : cached;
+}
+
+static void saveBinary(const cv::ocl::Program &program, const QString &path) {
+    std::vector<char> binary;
+    program.getBinary(binary);
+    if (binary.empty()) {
+        return;
+    }
+    // written aside and renamed, concurrent processes never load half a binary
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    file.write(binary.data(), static_cast<qint64>(binary.size()));
+    file.commit();
+}
+
+cv::ocl::Program oclProgram(cv::ocl::Context &context, const std::string &source, const std::string &options,
+                            const std::string &what) {
+    const cv::ocl::Device &device = context.device(0);
+    uint64_t key = 14695981039346656037ULL;
+    key = fnv1a(key, device.name());
+    key = fnv1a(key, device.driverVersion());
+    key = fnv1a(key, options);
+    key = fnv1a(key, source);
+
+    std::lock_guard lock(mutex);
+    const auto id = std::make_tuple(context.ptr(), key);
+    if (const auto it = programs.find(id); it != programs.end()) {
+        return it->second->program;
+    }
+    const QString path = binaryPath(key);
+    auto cached = loadBinary(context, path, options);
+    if (!cached) {
+        cached = std::make_shared<CachedProgram>();
+        std::string compileErrors;
+        cached->program = context.getProg(cv::ocl::ProgramSource(source), options, compileErrors);
+        if (cached->program.empty()) {
+            throw std::runtime_error("OpenCL " + what + " compilation failed" + compileErrors);
+        }
+        saveBinary(cached->program, path);
+    }
+    programs.emplace(id, cached);
+    return cached->program;
+}
@@ -0,0 +1,104 @@
+#include "askier/QualityController.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+QualityController::QualityController(const double targetMs) : targetMs(targetMs) {
+}
+
+void QualityController::setTarget(const double targetMs) {
+    this->targetMs = targetMs;
+    currentLevel = 0;
+    framesSinceChange = 0;
+    smoothedMs = -1.0;
+}
+
+void QualityController::rebuildLadder(const AsciiParams &requested) {
+    ladder.clear();
+    ladder.push_back(requested);
+    AsciiParams point = requested;
+    // error diffusion is the most expensive dithering, then ordered, then none
+    while (point.dithering != DitheringType::None) {
+        point.dithering = point.dithering == DitheringType::FloydSteinberg
+                              ? DitheringType::Ordered
+                              : DitheringType::None;
+        ladder.push_back(point);
+    }
+    // sub-cell resampling and matching against every glyph cost more than the LUT
+    if (point.matching != GlyphMatching::Density) {
+        point.matching = GlyphMatching::Density;
+        ladder.push_back(point);
+    }
+    if (point.edgeOperator != EdgeOperator::None) {
+        point.edgeOperator = EdgeOperator::None;
+        ladder.push_back(point);
+    }
+    while (point.columns > QUALITY_MIN_COLUMNS) {
+        point.columns = std::max(QUALITY_MIN_COLUMNS,
+                                 static_cast<int>(std::lround(point.columns * QUALITY_COLUMN_STEP)));
+        ladder.push_back(point);
+    }
+    currentLevel = 0;
+    framesSinceChange = 0;
+    smoothedMs = -1.0;
+}
+
+AsciiParams QualityController::apply(const AsciiParams &requested) {
+    if (!enabled()) {
+        return requested;
+    }
+    if (ladder.empty() || ladder.front() != requested) {
+        rebuildLadder(requested);
+    }
+    return ladder[currentLevel];
+}
+
+void QualityController::step(const int delta) {
+    const int next = std::clamp(currentLevel + delta, 0, static_cast<int>(ladder.size()) - 1);
+    if (next == currentLevel) {
+        return;
+    }
+    currentLevel = next;
+    framesSinceChange = 0;
+    // frames of the previous point say nothing about the new one
+    smoothedMs = -1.0;
+}
+
+void QualityController::record(const AsciiPipeline::Timings &timings) {
+    if (!enabled() || ladder.empty()) {
+        return;
+    }
+    const double ms = timings.busyMs();
+    smoothedMs = smoothedMs < 0.0
+                     ? ms
+                     : QUALITY_FRAME_TIME_SMOOTHING * ms + (1.0 - QUALITY_FRAME_TIME_SMOOTHING) * smoothedMs;
+    ++framesSinceChange;
+    if (smoothedMs > targetMs && framesSinceChange >= QUALITY_DOWNGRADE_FRAMES) {
+        step(1);
+    } else if (smoothedMs < targetMs * QUALITY_UPGRADE_HEADROOM && framesSinceChange >= QUALITY_UPGRADE_FRAMES) {
+        step(-1);
+    }
+}
+
+QString QualityController::describe() const {
+    if (ladder.empty()) {
+        return {};
+    }
+    const AsciiParams &point = ladder[currentLevel];
+    QString dithering = "no dithering";
+    if (point.dithering == DitheringType::FloydSteinberg) {
+        dithering = "Floyd-Steinberg";
+    } else if (point.dithering == DitheringType::Ordered) {
+        dithering = "ordered dithering";
+    }
+    QString edges = "no edges";
+    if (point.edgeOperator == EdgeOperator::Sobel) {
+        edges = "Sobel edges";
+    } else if (point.edgeOperator == EdgeOperator::Scharr) {
+        edges = "Scharr edges";
+    } else if (point.edgeOperator == EdgeOperator::Laplacian) {
+        edges = "Laplacian edges";
+    }
+    const QString matching = point.matching == GlyphMatching::Structure ? "structure" : "density";
+    return QString("%1 columns, %2, %3, %4 matching").arg(point.columns).arg(dithering).arg(edges).arg(matching);
+}
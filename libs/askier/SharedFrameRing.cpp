@@ -0,0 +1,278 @@
+#include "askier/SharedFrameRing.hpp"
+
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace shared_frame_ring;
+
+
+#ifdef __linux__
+static std::runtime_error systemError(const std::string &what, const std::string &name) {
+    return std::runtime_error(what + " " + name + ": " + std::strerror(errno));
+}
+
+/**
+ * Whether the object at name is a ring whose writer exited without unlinking
+ * it. Anything else, including rings of other versions, is left alone.
+ */
+static bool abandoned(const std::string &name) {
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        // unlinked meanwhile
+        return errno == ENOENT;
+    }
+    bool stale = false;
+    struct stat status{};
+    if (fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) >= alignUp(sizeof(Header))) {
+        void *mapped = mmap(nullptr, alignUp(sizeof(Header)), PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped != MAP_FAILED) {
+            const auto *header = static_cast<const Header *>(mapped);
+            stale = std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0 && header->version == VERSION &&
+                    header->writerPid > 0 && kill(static_cast<pid_t>(header->writerPid), 0) != 0 &&
+                    errno == ESRCH;
+            munmap(mapped, alignUp(sizeof(Header)));
+        }
+    }
+    close(fd);
+    return stale;
+}
+
+static void *createMapping(const std::string &name, const size_t bytes) {
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 && errno == EEXIST && abandoned(name)) {
+        shm_unlink(name.c_str());
+        fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    }
+    if (fd < 0) {
+        if (errno == EEXIST) {
+            throw std::runtime_error("Shared memory " + name + " is in use by another writer, or not a frame "
+                                     "ring; remove /dev/shm" + name + " if it is left over");
+        }
+        throw systemError("Failed to create shared memory", name);
+    }
+    if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+        const auto error = systemError("Failed to size shared memory", name);
+        close(fd);
+        shm_unlink(name.c_str());
+        throw error;
+    }
+    void *mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        throw systemError("Failed to map shared memory", name);
+    }
+    return mapped;
+}
+
+static const void *openMapping(const std::string &name, size_t &bytes) {
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        throw systemError("Failed to open shared memory", name);
+    }
+    struct stat status{};
+    if (fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) < alignUp(sizeof(Header))) {
+        close(fd);
+        throw std::runtime_error("Shared memory " + name + " is no frame ring");
+    }
+    bytes = static_cast<size_t>(status.st_size);
+    void *mapped = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        throw systemError("Failed to map shared memory", name);
+    }
+    return mapped;
+}
+
+static void closeMapping(const void *mapping, const size_t bytes) {
+    munmap(const_cast<void *>(mapping), bytes);
+}
+
+static void unlinkRing(const std::string &name) {
+    shm_unlink(name.c_str());
+}
+
+static uint32_t processId() {
+    return static_cast<uint32_t>(getpid());
+}
+#else
+static std::runtime_error unsupported() {
+    return std::runtime_error("Shared memory frame rings are only supported on Linux");
+}
+
+static void *createMapping(const std::string &, size_t) {
+    throw unsupported();
+}
+
+static const void *openMapping(const std::string &, size_t &) {
+    throw unsupported();
+}
+
+static void closeMapping(const void *, size_t) {
+}
+
+static void unlinkRing(const std::string &) {
+}
+
+static uint32_t processId() {
+    return 0;
+}
+#endif
+
+static uint8_t *slotData(Slot *slot) {
+    return reinterpret_cast<uint8_t *>(slot) + sizeof(Slot);
+}
+
+/**
+ * Copies rows of a strided image into contiguous memory
+ */
+static uint8_t *copyRows(uint8_t *dst, const uint8_t *src, const size_t rowBytes, const int rows,
+                         const size_t stride) {
+    for (int y = 0; y < rows; ++y) {
+        std::memcpy(dst, src + static_cast<size_t>(y) * stride, rowBytes);
+        dst += rowBytes;
+    }
+    return dst;
+}
+
+SharedFrameWriter::SharedFrameWriter(const std::string &name, const uint64_t slotBytes, const int slotCount)
+    : name_(name) {
+    if (slotCount < 2 || slotCount > UINT16_MAX) {
+        throw std::runtime_error("A frame ring needs between 2 and 65535 slots");
+    }
+    mappingBytes = shared_frame_ring::mappingBytes(static_cast<uint16_t>(slotCount), slotBytes);
+    mapping = createMapping(name, mappingBytes);
+    // the object is zero filled: no frame published, all slot sequences 0
+    auto *header = new(mapping) Header{};
+    std::memcpy(header->magic, MAGIC, sizeof(MAGIC));
+    header->version = VERSION;
+    header->slotCount = static_cast<uint16_t>(slotCount);
+    header->slotBytes = slotBytes;
+    // lets the next writer of the name tell a ring left behind from a live one
+    header->writerPid = processId();
+    for (int i = 0; i < slotCount; ++i) {
+        new(static_cast<uint8_t *>(mapping) + alignUp(sizeof(Header)) + i * slotStride(slotBytes)) Slot{};
+    }
+    header->latest.store(0, std::memory_order_release);
+}
+
+SharedFrameWriter::~SharedFrameWriter() {
+    if (mapping) {
+        closeMapping(mapping, mappingBytes);
+        // attached readers keep their mapping until they detach
+        unlinkRing(name_);
+    }
+}
+
+bool SharedFrameWriter::publish(const GlyphGrid &glyphs, const int64_t timestampUs, const QImage &colors,
+                                const QImage &preview) {
+    auto *header = static_cast<Header *>(mapping);
+    const size_t glyphBytes = static_cast<size_t>(glyphs.columns()) * glyphs.rows();
+    const bool hasColors = !colors.isNull();
+    const bool hasPreview = !preview.isNull();
+    if (hasColors && (colors.format() != QImage::Format_BGR888 || colors.width() != glyphs.columns() ||
+                      colors.height() != glyphs.rows())) {
+        throw std::runtime_error("Frame colors must be BGR888 of the glyph grid's size");
+    }
+    const int previewChannels = preview.format() == QImage::Format_BGR888 ? 3 : 1;
+    if (hasPreview && previewChannels == 1 && preview.format() != QImage::Format_Grayscale8) {
+        throw std::runtime_error("Frame previews must be Grayscale8 or BGR888");
+    }
+    const size_t colorBytes = hasColors ? 3 * glyphBytes : 0;
+    const size_t previewRowBytes = hasPreview ? static_cast<size_t>(preview.width()) * previewChannels : 0;
+    const size_t previewBytes = previewRowBytes * (hasPreview ? preview.height() : 0);
+    if (glyphBytes + colorBytes + previewBytes > header->slotBytes || glyphs.columns() > UINT16_MAX ||
+        glyphs.rows() > UINT16_MAX) {
+        return false;
+    }
+
+    const uint64_t frame = ++sequence;
+    auto *slot = reinterpret_cast<Slot *>(static_cast<uint8_t *>(mapping) + alignUp(sizeof(Header)) +
+                                          frame % header->slotCount * slotStride(header->slotBytes));
+    // odd while written, the frame's stores are ordered after it
+    slot->sequence.store(2 * frame - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->timestampUs = timestampUs;
+    slot->columns = static_cast<uint16_t>(glyphs.columns());
+    slot->rows = static_cast<uint16_t>(glyphs.rows());
+    slot->glyphSet = static_cast<uint8_t>(glyphs.glyphSet());
+    slot->flags = static_cast<uint8_t>((hasColors ? HAS_COLORS : 0) | (hasPreview ? HAS_PREVIEW : 0));
+    slot->previewChannels = hasPreview ? static_cast<uint8_t>(previewChannels) : 0;
+    slot->previewWidth = hasPreview ? static_cast<uint32_t>(preview.width()) : 0;
+    slot->previewHeight = hasPreview ? static_cast<uint32_t>(preview.height()) : 0;
+    uint8_t *data = copyRows(slotData(slot), glyphs.data(), glyphs.columns(), glyphs.rows(), glyphs.stride());
+    if (hasColors) {
+        data = copyRows(data, colors.constBits(), 3 * static_cast<size_t>(glyphs.columns()), glyphs.rows(),
+                        colors.bytesPerLine());
+    }
+    if (hasPreview) {
+        copyRows(data, preview.constBits(), previewRowBytes, preview.height(), preview.bytesPerLine());
+    }
+    slot->sequence.store(2 * frame, std::memory_order_release);
+    header->latest.store(frame, std::memory_order_release);
+    return true;
+}
+
+SharedFrameReader::SharedFrameReader(const std::string &name) {
+    mapping = openMapping(name, mappingBytes);
+    header = static_cast<const Header *>(mapping);
+    if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != VERSION ||
+        header->slotCount < 2 ||
+        shared_frame_ring::mappingBytes(header->slotCount, header->slotBytes) > mappingBytes) {
+        closeMapping(mapping, mappingBytes);
+        throw std::runtime_error("Shared memory " + name + " is no frame ring of version " +
+                                 std::to_string(VERSION));
+    }
+}
+
+SharedFrameReader::~SharedFrameReader() {
+    closeMapping(mapping, mappingBytes);
+}
+
+uint64_t SharedFrameReader::latest() const {
+    return header->latest.load(std::memory_order_acquire);
+}
+
+const Slot *SharedFrameReader::slotOf(const uint64_t frame) const {
+    return reinterpret_cast<const Slot *>(static_cast<const uint8_t *>(mapping) + alignUp(sizeof(Header)) +
+                                          frame % header->slotCount * slotStride(header->slotBytes));
+}
+
+SharedFrameView SharedFrameReader::view(const Slot &slot, const uint64_t frame) const {
+    SharedFrameView view;
+    view.sequence = frame;
+    view.timestampUs = slot.timestampUs;
+    view.columns = slot.columns;
+    view.rows = slot.rows;
+    view.glyphSet = static_cast<GlyphSet>(slot.glyphSet);
+    const size_t glyphBytes = static_cast<size_t>(view.columns) * view.rows;
+    const size_t previewBytes = static_cast<size_t>(slot.previewWidth) * slot.previewHeight * slot.previewChannels;
+    const size_t colorBytes = slot.flags & HAS_COLORS ? 3 * glyphBytes : 0;
+    // a torn header must not lead the reader out of the slot
+    if (glyphBytes + colorBytes + previewBytes > header->slotBytes) {
+        view.columns = view.rows = 0;
+        return view;
+    }
+    const auto *data = reinterpret_cast<const uint8_t *>(&slot) + sizeof(Slot);
+    view.glyphs = data;
+    if (slot.flags & HAS_COLORS) {
+        view.colors = data + glyphBytes;
+    }
+    if (slot.flags & HAS_PREVIEW) {
+        view.preview = data + glyphBytes + colorBytes;
+        view.previewWidth = static_cast<int>(slot.previewWidth);
+        view.previewHeight = static_cast<int>(slot.previewHeight);
+        view.previewChannels = slot.previewChannels;
+    }
+    return view;
+}
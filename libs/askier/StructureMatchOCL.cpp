@@ -0,0 +1,156 @@
+#include "askier/StructureMatchOCL.hpp"
+#include <askier/Constants.hpp>
+#include <askier/KernelAutotuner.hpp>
+#include <askier/OclProgramCache.hpp>
+
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <opencv2/core/hal/intrin.hpp>
+#include <opencv2/core/mat.hpp>
+#include <opencv2/core/ocl.hpp>
+#include <opencv2/imgproc.hpp>
+
+
+static std::string kernel_source = R"SRC(
+kernel void ascii_match_structure(
+__global const float *src,
+__global const float *features,
+__local float *local_features,
+__global uchar *dst,
+int rows,
+int cols,
+int glyph_count,
+int first_glyph
+)
+{
+    // the whole work-group stages the features before any cell is matched
+    const int lid = get_local_id(1) * get_local_size(0) + get_local_id(0);
+    const int group_size = get_local_size(0) * get_local_size(1);
+    for (int i = lid; i < glyph_count * 16; i += group_size) {
+        local_features[i] = features[i];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= cols || y >= rows) {
+        return;
+    }
+    const int src_cols = cols * 4;
+    __global const float *block = src + (y * 4) * src_cols + x * 4;
+    const float16 cell = (float16)(
+        vload4(0, block),
+        vload4(0, block + src_cols),
+        vload4(0, block + 2 * src_cols),
+        vload4(0, block + 3 * src_cols)
+    );
+
+    float best_distance = MAXFLOAT;
+    int best_glyph = 0;
+    for (int glyph = 0; glyph < glyph_count; ++glyph) {
+        const float16 difference = cell - vload16(glyph, local_features);
+        const float16 squared = difference * difference;
+        const float4 partial = squared.lo.lo + squared.lo.hi + squared.hi.lo + squared.hi.hi;
+        const float distance = partial.x + partial.y + partial.z + partial.w;
+        if (distance < best_distance) {
+            best_distance = distance;
+            best_glyph = glyph;
+        }
+    }
+    dst[y * cols + x] = (uchar) (first_glyph + best_glyph);
+}
+)SRC";
+
+cv::Mat glyph_structure_features(const GlyphDensityCalibrator &calibrator) {
+    const int width = calibrator.pixmapWidths()[0];
+    const int height = calibrator.pixmapHeights()[0];
+    const auto &pixmaps = calibrator.pixmaps();
+    if (pixmaps.size() != static_cast<size_t>(width) * height * ASCII_COUNT) {
+        throw std::runtime_error("Glyph pixmaps do not cover the ASCII range");
+    }
+    cv::Mat features(ASCII_COUNT, STRUCTURE_FEATURES, CV_32F);
+    cv::Mat luminance, blocks;
+    for (int glyph = 0; glyph < ASCII_COUNT; ++glyph) {
+        const cv::Mat pixmap(height, width, CV_8U,
+                             const_cast<unsigned char *>(pixmaps.data()) + static_cast<size_t>(glyph) * width * height);
+        pixmap.convertTo(luminance, CV_32F, 1.0 / 255.0);
+        cv::resize(luminance, blocks, cv::Size(STRUCTURE_BLOCKS, STRUCTURE_BLOCKS), 0, 0, cv::INTER_AREA);
+        blocks.reshape(1, 1).copyTo(features.row(glyph));
+    }
+    return features;
+}
+
+cv::UMat ascii_match_structure_ocl(cv::ocl::Context &context, const cv::UMat &src,
+                                   const cv::UMat &deviceFeatures, cv::UMatUsageFlags usage,
+                                   const std::array<size_t, 2> &localSize) {
+    CV_Assert(src.type() == CV_32F);
+    CV_Assert(src.isContinuous());
+    CV_Assert(src.cols % STRUCTURE_BLOCKS == 0 && src.rows % STRUCTURE_BLOCKS == 0);
+    CV_Assert(deviceFeatures.type() == CV_32F && deviceFeatures.isContinuous());
+    CV_Assert(deviceFeatures.rows == ASCII_COUNT && deviceFeatures.cols == STRUCTURE_FEATURES);
+    cv::UMat dst(src.rows / STRUCTURE_BLOCKS, src.cols / STRUCTURE_BLOCKS, CV_8U, usage);
+
+    const cv::ocl::Program program = oclProgram(context, kernel_source, "", "structure matcher");
+    cv::ocl::Kernel kernel("ascii_match_structure", program);
+    CV_Assert(!kernel.empty());
+
+    kernel.args(
+        cv::ocl::KernelArg::PtrReadOnly(src),
+        cv::ocl::KernelArg::PtrReadOnly(deviceFeatures),
+        cv::ocl::KernelArg::Local(deviceFeatures.total() * sizeof(float)),
+        cv::ocl::KernelArg::PtrWriteOnly(dst),
+        dst.rows,
+        dst.cols,
+        ASCII_COUNT,
+        ASCII_MIN
+    );
+    // enqueue only, consumers are ordered after it on the same queue
+    CV_Assert(runKernel2D(kernel, dst.cols, dst.rows, localSize, false));
+    return dst;
+}
+
+void ascii_match_structure_cpu(const cv::Mat &src, const cv::Mat &features, cv::Mat &glyphs) {
+    CV_Assert(src.type() == CV_32F);
+    CV_Assert(src.cols % STRUCTURE_BLOCKS == 0 && src.rows % STRUCTURE_BLOCKS == 0);
+    CV_Assert(features.type() == CV_32F && features.isContinuous());
+    CV_Assert(features.rows == ASCII_COUNT && features.cols == STRUCTURE_FEATURES);
+    static_assert(STRUCTURE_BLOCKS == cv::v_float32x4::nlanes, "one register per sub-block row");
+    glyphs.create(src.rows / STRUCTURE_BLOCKS, src.cols / STRUCTURE_BLOCKS, CV_8U);
+    cv::parallel_for_(cv::Range(0, glyphs.rows), [&src, &features, &glyphs](const cv::Range &range) {
+        const auto *glyphFeatures = features.ptr<float>();
+        for (int y = range.start; y < range.end; ++y) {
+            const float *blockRows[STRUCTURE_BLOCKS];
+            for (int row = 0; row < STRUCTURE_BLOCKS; ++row) {
+                blockRows[row] = src.ptr<float>(y * STRUCTURE_BLOCKS + row);
+            }
+            auto *out = glyphs.ptr<uchar>(y);
+            for (int x = 0; x < glyphs.cols; ++x) {
+                const int offset = x * STRUCTURE_BLOCKS;
+                const cv::v_float32x4 cell0 = cv::v_load(blockRows[0] + offset);
+                const cv::v_float32x4 cell1 = cv::v_load(blockRows[1] + offset);
+                const cv::v_float32x4 cell2 = cv::v_load(blockRows[2] + offset);
+                const cv::v_float32x4 cell3 = cv::v_load(blockRows[3] + offset);
+                float bestDistance = std::numeric_limits<float>::max();
+                int bestGlyph = 0;
+                for (int glyph = 0; glyph < ASCII_COUNT; ++glyph) {
+                    const float *feature = glyphFeatures + glyph * STRUCTURE_FEATURES;
+                    const cv::v_float32x4 d0 = cell0 - cv::v_load(feature);
+                    const cv::v_float32x4 d1 = cell1 - cv::v_load(feature + 4);
+                    const cv::v_float32x4 d2 = cell2 - cv::v_load(feature + 8);
+                    const cv::v_float32x4 d3 = cell3 - cv::v_load(feature + 12);
+                    cv::v_float32x4 sum = d0 * d0;
+                    sum = cv::v_muladd(d1, d1, sum);
+                    sum = cv::v_muladd(d2, d2, sum);
+                    sum = cv::v_muladd(d3, d3, sum);
+                    const float distance = cv::v_reduce_sum(sum);
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        bestGlyph = glyph;
+                    }
+                }
+                out[x] = static_cast<uchar>(ASCII_MIN + bestGlyph);
+            }
+        }
+    });
+}
@@ -0,0 +1,71 @@
+#include "askier/SubCellPackOCL.hpp"
+#include <askier/Constants.hpp>
+#include <askier/KernelAutotuner.hpp>
+#include <askier/OclProgramCache.hpp>
+
+#include <stdexcept>
+#include <string>
+#include <opencv2/core/mat.hpp>
+#include <opencv2/core/ocl.hpp>
+
+
+static std::string kernel_source = R"SRC(
+kernel void ascii_pack_subcells(
+__global const float *src,
+__global uchar *dst,
+int rows,
+int cols,
+int sub_cols,
+int sub_rows,
+int braille,
+float threshold
+)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= cols || y >= rows) {
+        return;
+    }
+    const int src_cols = cols * sub_cols;
+    int code = 0;
+    for (int sy = 0; sy < sub_rows; ++sy) {
+        __global const float *row = src + (y * sub_rows + sy) * src_cols + x * sub_cols;
+        for (int sx = 0; sx < sub_cols; ++sx) {
+            if (row[sx] < threshold) {
+                // braille dots 1-6 run down the columns, 7 and 8 form the bottom row
+                const int bit = braille ? (sy == 3 ? 6 + sx : 3 * sx + sy) : sy * sub_cols + sx;
+                code |= 1 << bit;
+            }
+        }
+    }
+    dst[y * cols + x] = (uchar) code;
+}
+)SRC";
+
+cv::UMat ascii_pack_subcells_ocl(cv::ocl::Context &context, const cv::UMat &src, const GlyphSet set,
+                                 cv::UMatUsageFlags usage, const std::array<size_t, 2> &localSize) {
+    const auto layout = glyphSetLayout(set);
+    CV_Assert(set != GlyphSet::Ascii);
+    CV_Assert(src.type() == CV_32F);
+    CV_Assert(src.isContinuous());
+    CV_Assert(src.cols % layout.columns == 0 && src.rows % layout.rows == 0);
+    cv::UMat dst(src.rows / layout.rows, src.cols / layout.columns, CV_8U, usage);
+
+    const cv::ocl::Program program = oclProgram(context, kernel_source, "", "sub-cell packing");
+    cv::ocl::Kernel kernel("ascii_pack_subcells", program);
+    CV_Assert(!kernel.empty());
+
+    kernel.args(
+        cv::ocl::KernelArg::PtrReadOnly(src),
+        cv::ocl::KernelArg::PtrWriteOnly(dst),
+        dst.rows,
+        dst.cols,
+        layout.columns,
+        layout.rows,
+        set == GlyphSet::Braille ? 1 : 0,
+        SUBCELL_INK_THRESHOLD
+    );
+    // enqueue only, consumers are ordered after it on the same queue
+    CV_Assert(runKernel2D(kernel, dst.cols, dst.rows, localSize, false));
+    return dst;
+}
@@ -0,0 +1,192 @@
+#include "askier/TerminalPlayer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+// unchanged cells between two changed ones rewritten instead of moving the cursor
+constexpr int RUN_MERGE_GAP = 8;
+
+static void appendInt(std::string &out, const int value) {
+    char buffer[16];
+    const auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, end);
+}
+
+TerminalPlayer::TerminalPlayer(AsciiRecordingReader &reader, const int fd) : reader(reader), fd(fd) {
+}
+
+void TerminalPlayer::decodeAhead() {
+    try {
+        for (size_t i = 0; i < reader.frameCount(); ++i) {
+            AsciiFrame frame = reader.frame(i);
+            std::unique_lock lock(mutex);
+            changed.wait(lock, [this]() { return stopping || decoded.size() < PLAYBACK_DECODE_AHEAD; });
+            if (stopping) {
+                break;
+            }
+            decoded.push_back(std::move(frame));
+            lock.unlock();
+            changed.notify_all();
+        }
+    } catch (...) {
+        std::lock_guard lock(mutex);
+        decodeError = std::current_exception();
+    }
+    {
+        std::lock_guard lock(mutex);
+        decoderDone = true;
+    }
+    changed.notify_all();
+}
+
+void TerminalPlayer::stopDecoder() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+}
+
+void TerminalPlayer::compose(const AsciiFrame &frame) {
+    const bool color = !frame.colors.empty();
+    const size_t cells = static_cast<size_t>(frame.columns) * frame.rows;
+    const bool full = frame.columns != screenColumns || frame.rows != screenRows || color != screenHasColor;
+    if (full) {
+        out += "\x1b[0m\x1b[2J";
+        foreground = -1;
+        screenColumns = frame.columns;
+        screenRows = frame.rows;
+        screenHasColor = color;
+        screenGlyphs.assign(cells, 0);
+        screenColors.assign(color ? 3 * cells : 0, 0);
+    }
+    const auto differs = [&](const size_t i) {
+        return full || screenGlyphs[i] != frame.glyphs[i] ||
+               (color && (screenColors[3 * i] != frame.colors[3 * i] ||
+                          screenColors[3 * i + 1] != frame.colors[3 * i + 1] ||
+                          screenColors[3 * i + 2] != frame.colors[3 * i + 2]));
+    };
+
+    for (int y = 0; y < frame.rows; ++y) {
+        const size_t row = static_cast<size_t>(y) * frame.columns;
+        int x = 0;
+        while (x < frame.columns) {
+            if (!differs(row + x)) {
+                ++x;
+                continue;
+            }
+            int end = x + 1;
+            for (int probe = end; probe < frame.columns && probe - end < RUN_MERGE_GAP; ++probe) {
+                if (differs(row + probe)) {
+                    end = probe + 1;
+                }
+            }
+            out += "\x1b[";
+            appendInt(out, y + 1);
+            out += ';';
+            appendInt(out, x + 1);
+            out += 'H';
+            for (; x < end; ++x) {
+                const size_t i = row + x;
+                if (color) {
+                    const uint8_t *bgr = frame.colors.data() + 3 * i;
+                    const int64_t rgb = bgr[2] << 16 | bgr[1] << 8 | bgr[0];
+                    if (rgb != foreground) {
+                        out += "\x1b[38;2;";
+                        appendInt(out, bgr[2]);
+                        out += ';';
+                        appendInt(out, bgr[1]);
+                        out += ';';
+                        appendInt(out, bgr[0]);
+                        out += 'm';
+                        foreground = rgb;
+                    }
+                    std::copy_n(bgr, 3, screenColors.data() + 3 * i);
+                }
+                const uint8_t glyph = frame.glyphs[i];
+                appendGlyphUtf8(out, reader.charset(), glyph);
+                screenGlyphs[i] = glyph;
+            }
+        }
+    }
+}
+
+void TerminalPlayer::flush() {
+    const char *data = out.data();
+    size_t left = out.size();
+    while (left > 0) {
+        const ssize_t n = ::write(fd, data, left);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            throw std::runtime_error("Failed to write to terminal");
+        }
+        data += n;
+        left -= static_cast<size_t>(n);
+    }
+    stats.bytesWritten += out.size();
+    out.clear();
+}
+
+TerminalPlayer::Stats TerminalPlayer::play(const bool realtime, const std::atomic<bool> &cancelled) {
+    using Clock = std::chrono::steady_clock;
+    stats = {};
+    decoded.clear();
+    decoderDone = stopping = false;
+    decodeError = nullptr;
+    screenColumns = screenRows = 0;
+    std::thread decoder(&TerminalPlayer::decodeAhead, this);
+
+    const size_t count = reader.frameCount();
+    const int64_t firstTimestamp = count > 0 ? reader.timestampUs(0) : 0;
+    const auto start = Clock::now();
+    const auto dueAt = [&](const size_t frame) {
+        return start + std::chrono::microseconds(reader.timestampUs(frame) - firstTimestamp);
+    };
+    try {
+        out += "\x1b[?25l";
+        for (size_t frameNumber = 0; !cancelled; ++frameNumber) {
+            AsciiFrame frame;
+            {
+                std::unique_lock lock(mutex);
+                changed.wait(lock, [this]() { return !decoded.empty() || decoderDone; });
+                if (decoded.empty()) {
+                    break;
+                }
+                frame = std::move(decoded.front());
+                decoded.pop_front();
+            }
+            changed.notify_all();
+            if (realtime) {
+                // a frame whose successor is already due is never seen, skip it
+                if (frameNumber + 1 < count && Clock::now() >= dueAt(frameNumber + 1)) {
+                    ++stats.framesDropped;
+                    continue;
+                }
+                std::this_thread::sleep_until(dueAt(frameNumber));
+            }
+            compose(frame);
+            flush();
+            ++stats.framesShown;
+        }
+        out += "\x1b[0m\x1b[?25h\n";
+        flush();
+    } catch (...) {
+        stopDecoder();
+        decoder.join();
+        throw;
+    }
+    stopDecoder();
+    decoder.join();
+    stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    if (decodeError) {
+        std::rethrow_exception(decodeError);
+    }
+    return stats;
+}
@@ -0,0 +1,147 @@
+#include "askier/ToneRemapOCL.hpp"
+#include <askier/Constants.hpp>
+#include <askier/OclProgramCache.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <opencv2/core/mat.hpp>
+#include <opencv2/core/ocl.hpp>
+
+
+static std::string kernel_source = R"SRC(
+kernel void tone_histogram(
+__global const float *cells,
+int total,
+__global int *histogram,
+__local int *local_histogram
+)
+{
+    const int lid = get_local_id(0);
+    for (int i = lid; i < TONE_REMAP_BINS; i += get_local_size(0)) {
+        local_histogram[i] = 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int i = get_global_id(0); i < total; i += get_global_size(0)) {
+        const int bin = (int) round(clamp(cells[i], 0.0f, 1.0f) * (TONE_REMAP_BINS - 1));
+        atomic_inc(&local_histogram[bin]);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    // one global atomic per populated bin and work-group
+    for (int i = lid; i < TONE_REMAP_BINS; i += get_local_size(0)) {
+        const int count = local_histogram[i];
+        if (count > 0) {
+            atomic_add(&histogram[i], count);
+        }
+    }
+}
+
+kernel void tone_remap_build(
+__global int *histogram,
+__global float *remap,
+int mode,
+float percentile,
+float smoothing,
+int reset
+)
+{
+    int total = 0;
+    for (int i = 0; i < TONE_REMAP_BINS; ++i) {
+        total += histogram[i];
+    }
+    int low = 0;
+    int high = TONE_REMAP_BINS - 1;
+    if (mode == 2 && total > 0) {
+        // stretch, bins holding the percentiles
+        int cumulative = 0;
+        int percentile_low = -1;
+        int percentile_high = high;
+        for (int i = 0; i < TONE_REMAP_BINS; ++i) {
+            cumulative += histogram[i];
+            if (percentile_low < 0 && cumulative > percentile * total) {
+                percentile_low = i;
+            }
+            if (cumulative >= (1.0f - percentile) * total) {
+                percentile_high = i;
+                break;
+            }
+        }
+        // a flat frame has no range to stretch
+        if (percentile_high > percentile_low) {
+            low = percentile_low;
+            high = percentile_high;
+        }
+    }
+    int below = 0;
+    for (int i = 0; i < TONE_REMAP_BINS; ++i) {
+        const int count = histogram[i];
+        float target = clamp((float) (i - low) / (float) (high - low), 0.0f, 1.0f);
+        if (mode == 1 && total > 0) {
+            // equalize, midpoint of the bin in the cumulative distribution
+            target = ((float) below + 0.5f * (float) count) / (float) total;
+        }
+        below += count;
+        remap[i] = reset ? target : mix(remap[i], target, smoothing);
+        histogram[i] = 0;
+    }
+}
+)SRC";
+
+// upper bound of work-groups in the histogram, each loops over its share
+constexpr size_t MAX_HISTOGRAM_GROUPS = 64;
+
+static void initState(ToneRemapState &state) {
+    if (!state.histogram.empty()) {
+        return;
+    }
+    state.histogram.create(1, TONE_REMAP_BINS, CV_32S, cv::USAGE_ALLOCATE_DEVICE_MEMORY);
+    // the build kernel clears it again for the next frame
+    state.histogram.setTo(cv::Scalar::all(0));
+    state.remap.create(1, TONE_REMAP_BINS, CV_32F, cv::USAGE_ALLOCATE_DEVICE_MEMORY);
+    state.reset = true;
+}
+
+std::string tone_remap_build_options() {
+    return "-D TONE_REMAP -D TONE_REMAP_BINS=" + std::to_string(TONE_REMAP_BINS);
+}
+
+void tone_remap_update_ocl(cv::ocl::Context &context, const cv::UMat &cells, const ToneRemap mode,
+                           ToneRemapState &state) {
+    CV_Assert(mode != ToneRemap::None);
+    CV_Assert(cells.type() == CV_32F);
+    CV_Assert(cells.isContinuous());
+    initState(state);
+    const int total = static_cast<int>(cells.total());
+
+    const cv::ocl::Program program = oclProgram(context, kernel_source, tone_remap_build_options(), "tone remap");
+
+    cv::ocl::Kernel histogram("tone_histogram", program);
+    CV_Assert(!histogram.empty());
+    const size_t localSize = std::min<size_t>(TONE_REMAP_BINS, cv::ocl::Device::getDefault().maxWorkGroupSize());
+    histogram.args(
+        cv::ocl::KernelArg::PtrReadOnly(cells),
+        total,
+        cv::ocl::KernelArg::PtrReadWrite(state.histogram),
+        cv::ocl::KernelArg::Local(TONE_REMAP_BINS * sizeof(int))
+    );
+    const size_t groups = std::clamp<size_t>((static_cast<size_t>(total) + localSize - 1) / localSize, 1,
+                                             MAX_HISTOGRAM_GROUPS);
+    size_t histogramGlobal[1] = {groups * localSize};
+    size_t histogramLocal[1] = {localSize};
+    CV_Assert(histogram.run(1, histogramGlobal, histogramLocal, false));
+
+    cv::ocl::Kernel build("tone_remap_build", program);
+    CV_Assert(!build.empty());
+    build.args(
+        cv::ocl::KernelArg::PtrReadWrite(state.histogram),
+        cv::ocl::KernelArg::PtrReadWrite(state.remap),
+        static_cast<int>(mode),
+        TONE_REMAP_PERCENTILE,
+        TONE_REMAP_SMOOTHING,
+        state.reset ? 1 : 0
+    );
+    size_t single[1] = {1};
+    // enqueue only, the LUT kernels reading the remap are ordered after it on the same queue
+    CV_Assert(build.run(1, single, nullptr, false));
+    state.reset = false;
+}
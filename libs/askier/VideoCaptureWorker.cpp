@@ -14,6 +14,10 @@ void VideoCaptureWorker::stop() {
     is_running = false;
 }
 
+void VideoCaptureWorker::markFrameConsumed() {
+    frame_pending = false;
+}
+
 void VideoCaptureWorker::run() {
     cv::VideoCapture cap(device_index);
     if (!cap.isOpened()) {
@@ -27,8 +31,15 @@ void VideoCaptureWorker::run() {
         if (!cap.read(frame)) {
             break;
         }
-        cv::flip(frame, frame, 1); // Mirror the frame
-        emit frameCaptured(frame.clone());
+        if (frame_pending.exchange(true)) {
+            ++skipped_frames;
+            msleep(16);
+            continue;
+        }
+        // Mirroring into a fresh matrix doubles as the copy out of the capture buffer
+        cv::Mat mirrored;
+        cv::flip(frame, mirrored, 1);
+        emit frameCaptured(mirrored);
         msleep(16); // 60 fps
     }
 }
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include "gui/ConversionParamsDialog.hpp"
 
+#include <utility>
+#include <vector>
+#include <QColorDialog>
 #include <QHBoxLayout>
 #include <QVBoxLayout>
 
@@ -8,6 +11,36 @@ static const std::string NONE_DITHERING = "None";
 static const std::string FLOYD_STEINBERG_DITHERING = "Floyd-Steinberg";
 static const std::string ATKINSON_DITHERING = "Ordered";
 
+static const std::vector<std::pair<QString, EdgeOperator> > EDGE_OPERATORS = {
+    {"None", EdgeOperator::None},
+    {"Sobel", EdgeOperator::Sobel},
+    {"Scharr", EdgeOperator::Scharr},
+    {"Laplacian", EdgeOperator::Laplacian},
+};
+
+static const std::vector<std::pair<QString, GlyphSet> > GLYPH_SETS = {
+    {"ASCII", GlyphSet::Ascii},
+    {"Braille (2x4 dots)", GlyphSet::Braille},
+    {"Blocks (2x2 quadrants)", GlyphSet::Blocks},
+};
+
+static const std::vector<std::pair<QString, GlyphMatching> > GLYPH_MATCHINGS = {
+    {"Density", GlyphMatching::Density},
+    {"Structure", GlyphMatching::Structure},
+};
+
+static const std::vector<std::pair<QString, ToneRemap> > TONE_REMAPS = {
+    {"Linear", ToneRemap::None},
+    {"Equalize", ToneRemap::Equalize},
+    {"Stretch", ToneRemap::Stretch},
+};
+
+static const std::vector<std::pair<QString, EdgeNormalization> > EDGE_NORMALIZATIONS = {
+    {"Exact range", EdgeNormalization::MinMax},
+    {"Running range", EdgeNormalization::Running},
+    {"Previous frame range", EdgeNormalization::PreviousFrame},
+};
+
 
 ConversionParamsDialog::ConversionParamsDialog(const AsciiParams &currentParams, QWidget *parent) : QDialog(parent),
     params(currentParams) {
@@ -49,9 +82,114 @@ ConversionParamsDialog::ConversionParamsDialog(const AsciiParams &currentParams,
     connect(columns_slider, &QSlider::valueChanged, this, [colsValue, this](int value) {
         colsValue->setText(QString::number(value));
         this->params.columns = value;
+        emit paramsChanged(this->params);
     });
     colsSliderOuterLayout->addWidget(colsValue);
 
+    edge_combo = new QComboBox(this);
+    for (const auto &[name, edgeOperator]: EDGE_OPERATORS) {
+        edge_combo->addItem(name, static_cast<int>(edgeOperator));
+    }
+    edge_combo->setCurrentIndex(edge_combo->findData(static_cast<int>(params.edgeOperator)));
+    connect(edge_combo, &QComboBox::currentIndexChanged, this, [this](int index) {
+        this->params.edgeOperator = static_cast<EdgeOperator>(edge_combo->itemData(index).toInt());
+        emit paramsChanged(this->params);
+    });
+
+    edge_strength_slider = new DoubleSlider(Qt::Horizontal, this);
+    edge_strength_slider->setDecimals(2);
+    edge_strength_slider->setRange(0.0, 1.0);
+    edge_strength_slider->setValue(params.edgeStrength);
+    connect(edge_strength_slider, &DoubleSlider::valueChanged, this, [this](double value) {
+        this->params.edgeStrength = static_cast<float>(value);
+        emit paramsChanged(this->params);
+    });
+
+    normalization_combo = new QComboBox(this);
+    for (const auto &[name, normalization]: EDGE_NORMALIZATIONS) {
+        normalization_combo->addItem(name, static_cast<int>(normalization));
+    }
+    normalization_combo->setToolTip("Live mode only: the approximate ranges avoid waiting for each frame");
+    normalization_combo->setCurrentIndex(
+        normalization_combo->findData(static_cast<int>(params.edgeNormalization)));
+    connect(normalization_combo, &QComboBox::currentIndexChanged, this, [this](int index) {
+        this->params.edgeNormalization = static_cast<EdgeNormalization>(
+            normalization_combo->itemData(index).toInt());
+        emit paramsChanged(this->params);
+    });
+
+    glyph_set_combo = new QComboBox(this);
+    for (const auto &[name, set]: GLYPH_SETS) {
+        glyph_set_combo->addItem(name, static_cast<int>(set));
+    }
+    glyph_set_combo->setCurrentIndex(glyph_set_combo->findData(static_cast<int>(params.glyphSet)));
+    connect(glyph_set_combo, &QComboBox::currentIndexChanged, this, [this](int index) {
+        this->params.glyphSet = static_cast<GlyphSet>(glyph_set_combo->itemData(index).toInt());
+        matching_combo->setEnabled(this->params.glyphSet == GlyphSet::Ascii);
+        updateDensityOptions();
+        emit paramsChanged(this->params);
+    });
+
+    matching_combo = new QComboBox(this);
+    for (const auto &[name, matching]: GLYPH_MATCHINGS) {
+        matching_combo->addItem(name, static_cast<int>(matching));
+    }
+    matching_combo->setToolTip("Structure picks glyphs by their shape within the cell, sharper for line art");
+    matching_combo->setCurrentIndex(matching_combo->findData(static_cast<int>(params.matching)));
+    matching_combo->setEnabled(params.glyphSet == GlyphSet::Ascii);
+    connect(matching_combo, &QComboBox::currentIndexChanged, this, [this](int index) {
+        this->params.matching = static_cast<GlyphMatching>(matching_combo->itemData(index).toInt());
+        updateDensityOptions();
+        emit paramsChanged(this->params);
+    });
+
+    tone_combo = new QComboBox(this);
+    for (const auto &[name, tone]: TONE_REMAPS) {
+        tone_combo->addItem(name, static_cast<int>(tone));
+    }
+    tone_combo->setToolTip("Spreads dark or washed-out frames over more glyphs, smoothed over time in live mode");
+    tone_combo->setCurrentIndex(tone_combo->findData(static_cast<int>(params.toneRemap)));
+    connect(tone_combo, &QComboBox::currentIndexChanged, this, [this](int index) {
+        this->params.toneRemap = static_cast<ToneRemap>(tone_combo->itemData(index).toInt());
+        emit paramsChanged(this->params);
+    });
+
+    hysteresis_checkbox = new QCheckBox("Suppress glyph flicker", this);
+    hysteresis_checkbox->setToolTip("Live mode only: cells keep their glyph until the luminance clearly changed");
+    hysteresis_checkbox->setChecked(params.glyphHysteresis > 0.0f);
+    connect(hysteresis_checkbox, &QCheckBox::toggled, this, [this](bool checked) {
+        this->params.glyphHysteresis = checked ? DEFAULT_GLYPH_HYSTERESIS : 0.0f;
+        emit paramsChanged(this->params);
+    });
+
+    color_checkbox = new QCheckBox("Color preview", this);
+    color_checkbox->setToolTip("Draws each glyph in the mean color of its cell");
+    color_checkbox->setChecked(params.colorPreview);
+    background_button = new QPushButton("Background...", this);
+    background_button->setEnabled(params.colorPreview);
+    connect(color_checkbox, &QCheckBox::toggled, this, [this](bool checked) {
+        this->params.colorPreview = checked;
+        background_button->setEnabled(checked);
+        updateDensityOptions();
+        emit paramsChanged(this->params);
+    });
+    connect(background_button, &QPushButton::clicked, this, [this] {
+        const QColor color = QColorDialog::getColor(this->params.previewBackground, this, "Preview background");
+        if (color.isValid()) {
+            this->params.previewBackground = color;
+            emit paramsChanged(this->params);
+        }
+    });
+
+    adaptive_checkbox = new QCheckBox("Adaptive cells", this);
+    adaptive_checkbox->setToolTip("Still images only: flat regions of the preview take larger glyphs");
+    adaptive_checkbox->setChecked(params.adaptiveCells);
+    connect(adaptive_checkbox, &QCheckBox::toggled, this, [this](bool checked) {
+        this->params.adaptiveCells = checked;
+        emit paramsChanged(this->params);
+    });
+    updateDensityOptions();
+
     apply_button = new QPushButton("Apply", this);
     connect(apply_button, &QPushButton::clicked, this, &ConversionParamsDialog::accept);
     cancel_button = new QPushButton("Cancel", this);
@@ -66,6 +204,37 @@ ConversionParamsDialog::ConversionParamsDialog(const AsciiParams &currentParams,
     layout->addSpacing(5);
     layout->addLayout(colsSliderOuterLayout);
     layout->addSpacing(5);
+    auto edgeLabel = new QLabel("Edges", this);
+    edgeLabel->setAlignment(Qt::AlignCenter);
+    layout->addWidget(edgeLabel);
+    layout->addWidget(edge_combo);
+    layout->addWidget(edge_strength_slider);
+    layout->addWidget(normalization_combo);
+    layout->addSpacing(5);
+    auto glyphSetLabel = new QLabel("Characters", this);
+    glyphSetLabel->setAlignment(Qt::AlignCenter);
+    layout->addWidget(glyphSetLabel);
+    layout->addWidget(glyph_set_combo);
+    layout->addSpacing(5);
+    auto matchingLabel = new QLabel("Glyph matching", this);
+    matchingLabel->setAlignment(Qt::AlignCenter);
+    layout->addWidget(matchingLabel);
+    layout->addWidget(matching_combo);
+    layout->addSpacing(5);
+    auto toneLabel = new QLabel("Contrast", this);
+    toneLabel->setAlignment(Qt::AlignCenter);
+    layout->addWidget(toneLabel);
+    layout->addWidget(tone_combo);
+    layout->addSpacing(5);
+    layout->addWidget(hysteresis_checkbox);
+    layout->addSpacing(5);
+    QHBoxLayout *color_layout = new QHBoxLayout();
+    color_layout->addWidget(color_checkbox);
+    color_layout->addWidget(background_button);
+    layout->addLayout(color_layout);
+    layout->addSpacing(5);
+    layout->addWidget(adaptive_checkbox);
+    layout->addSpacing(5);
     QHBoxLayout *buttons_layout = new QHBoxLayout();
     buttons_layout->addWidget(apply_button);
     buttons_layout->addWidget(cancel_button);
@@ -75,6 +244,12 @@ ConversionParamsDialog::ConversionParamsDialog(const AsciiParams &currentParams,
 }
 
 
+void ConversionParamsDialog::updateDensityOptions() {
+    const bool density = params.glyphSet == GlyphSet::Ascii && params.matching == GlyphMatching::Density;
+    tone_combo->setEnabled(density);
+    adaptive_checkbox->setEnabled(density && !params.colorPreview);
+}
+
 AsciiParams ConversionParamsDialog::getParams() const {
     return params;
 }
@@ -87,4 +262,5 @@ void ConversionParamsDialog::onDitheringChanged(const QString &text) {
     } else if (text == ATKINSON_DITHERING.c_str()) {
         params.dithering = Ordered;
     }
+    emit paramsChanged(params);
 }
\ No newline at end of file
@@ -8,12 +8,21 @@
 #include <QWidget>
 #include <QStatusBar>
 #include <QFileDialog>
-#include <opencv2/imgcodecs.hpp>
 #include <QMessageBox>
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <thread>
 #include <QFontDialog>
 #include <QStandardPaths>
 #include <QList>
+#include <QActionGroup>
+#include <QFutureWatcher>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrentRun>
+#include <opencv2/imgproc.hpp>
 
 #include "askier/ImageUtils.hpp"
 #include "gui/ConversionParamsDialog.hpp"
@@ -28,6 +37,23 @@ static QPixmap fitPixmap(const QImage &img, const QSize &area) {
     return QPixmap::fromImage(img).scaled(area, Qt::KeepAspectRatio, Qt::SmoothTransformation);
 }
 
+// the ui thread joins the arena when it converts, one core stays with the capture thread
+static int hostThreads() {
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+}
+
+namespace {
+    struct StillPass {
+        uint64_t generation = 0;
+        // the still, decoded again when the columns asked for another reduction
+        cv::Mat bgr;
+        int decodeFactor = 1;
+        cv::Size sourceSize;
+        AsciiPipeline::Result result;
+        std::string error;
+    };
+}
+
 
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), params{
                                               .columns = 480,
@@ -36,8 +62,8 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), params{
                                           } {
     params.font.setStyleHint(QFont::Monospace);
     setupUi();
-    ensureCalibrator();
-    pipeline = std::make_unique<AsciiPipeline>(calibrator);
+    pipeline = std::make_unique<AsciiPipeline>(engines.get(params.font), HostExecutorConfig{.threads = hostThreads()});
+    pipeline->setMotionThreshold(actSkipStatic->isChecked() ? MOTION_GATE_THRESHOLD : 0.0);
     if (mode == InputMode::Camera) {
         startCamera();
     }
@@ -45,6 +71,8 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), params{
 
 MainWindow::~MainWindow() {
     stopCamera();
+    // pending glyph engine builds reference the engine cache, full resolution passes the still pipeline
+    QThreadPool::globalInstance()->waitForDone();
 }
 
 void MainWindow::setupUi() {
@@ -62,6 +90,10 @@ void MainWindow::setupUi() {
     actSaveAscii = new QAction("Save ASCII", this);
     connect(actSaveAscii, &QAction::triggered, this, &MainWindow::onSaveAscii);
 
+    actRecordAscii = new QAction("Record ASCII", this);
+    actRecordAscii->setCheckable(true);
+    connect(actRecordAscii, &QAction::toggled, this, &MainWindow::onToggleRecording);
+
     actChooseFont = new QAction("Choose font", this);
     connect(actChooseFont, &QAction::triggered, this, &MainWindow::onFontChanged);
 
@@ -72,10 +104,30 @@ void MainWindow::setupUi() {
     fileMenu->addAction(actOpenImage);
     fileMenu->addSeparator();
     fileMenu->addAction(actSaveAscii);
+    fileMenu->addAction(actRecordAscii);
     fileMenu->addSeparator();
     fileMenu->addAction(actChooseFont);
     fileMenu->addAction(actAdjustParams);
 
+    auto *budgetMenu = fileMenu->addMenu("Frame budget");
+    auto *budgetGroup = new QActionGroup(this);
+    for (const int ms: {0, 16, 33}) {
+        auto *action = budgetMenu->addAction(ms == 0 ? QString("Off") : QString("%1 ms").arg(ms));
+        action->setCheckable(true);
+        action->setChecked(ms == 0);
+        action->setData(ms);
+        budgetGroup->addAction(action);
+    }
+    connect(budgetGroup, &QActionGroup::triggered, this, &MainWindow::onFrameBudgetChanged);
+
+    actSkipStatic = new QAction("Skip static frames", this);
+    actSkipStatic->setCheckable(true);
+    actSkipStatic->setChecked(true);
+    connect(actSkipStatic, &QAction::toggled, this, [this](bool checked) {
+        pipeline->setMotionThreshold(checked ? MOTION_GATE_THRESHOLD : 0.0);
+    });
+    fileMenu->addAction(actSkipStatic);
+
     auto *central = new QWidget(this);
     auto *layout = new QHBoxLayout(central);
     auto *splitter = new QSplitter(Qt::Horizontal, central);
@@ -99,11 +151,53 @@ void MainWindow::setupUi() {
 
     setCentralWidget(central);
     statusBar()->showMessage("Ready");
+
+    livePreviewTimer = new QTimer(this);
+    livePreviewTimer->setSingleShot(true);
+    livePreviewTimer->setInterval(LIVE_PREVIEW_INTERVAL_MS);
+    connect(livePreviewTimer, &QTimer::timeout, this, &MainWindow::onLivePreviewTimeout);
+    liveSettleTimer = new QTimer(this);
+    liveSettleTimer->setSingleShot(true);
+    liveSettleTimer->setInterval(LIVE_PREVIEW_SETTLE_MS);
+    connect(liveSettleTimer, &QTimer::timeout, this, [this]() {
+        startStillPass(liveParams);
+    });
 }
 
-void MainWindow::ensureCalibrator() {
-    calibrator = std::make_shared<GlyphDensityCalibrator>(params.font);
-    calibrator->ensureCalibrated();
+double MainWindow::cellAspect() const {
+    return pipeline->glyphEngine()->calibrator->cellAspect();
+}
+
+void MainWindow::switchGlyphEngine() {
+    if (const auto cached = engines.find(params.font)) {
+        pipeline->setEngine(cached);
+        if (mode == ImageFile) {
+            refreshAsciiFromStill();
+        }
+        return;
+    }
+    // calibrate and upload off the ui thread, frames keep using the current engine meanwhile
+    statusBar()->showMessage("Calibrating " + params.font.family() + "...");
+    const QString key = GlyphDensityCalibrator::fontKey(params.font);
+    auto *watcher = new QFutureWatcher<std::shared_ptr<const GlyphEngine> >(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, key]() {
+        watcher->deleteLater();
+        if (key != GlyphDensityCalibrator::fontKey(params.font)) {
+            // superseded by a later font change
+            return;
+        }
+        try {
+            pipeline->setEngine(watcher->result());
+        } catch (const std::exception &e) {
+            QMessageBox::warning(this, "Choose font", QString("Failed to calibrate font: %1").arg(e.what()));
+            return;
+        }
+        statusBar()->showMessage("Using font " + key, 3000);
+        if (mode == ImageFile) {
+            refreshAsciiFromStill();
+        }
+    });
+    watcher->setFuture(engines.getAsync(params.font));
 }
 
 void MainWindow::startCamera() {
@@ -132,6 +226,8 @@ void MainWindow::onToggleMode() {
         actToggleMode->setText(SWITCH_TO_CAMERA_TEXT.c_str());
         actOpenImage->setEnabled(true);
         stopCamera();
+        // frames still in flight are stale once the still is shown
+        static_cast<void>(pipeline->drain());
         statusBar()->showMessage("Image mode");
     } else {
         mode = Camera;
@@ -150,19 +246,40 @@ void MainWindow::onOpenImage() {
     if (file.isEmpty()) {
         return;
     }
-    cv::Mat bgr = cv::imread(file.toStdString(), cv::IMREAD_COLOR);
-    if (bgr.empty()) {
+    stillPath = file;
+    if (!loadStill()) {
+        stillBgr.release();
         QMessageBox::warning(this, "Open Image", "Failed to load image.");
         return;
     }
-    stillBgr = bgr;
     refreshAsciiFromStill();
 }
 
+bool MainWindow::loadStill() {
+    // decode only as much resolution as the current columns can use
+    int factor = 1;
+    cv::Size sourceSize;
+    cv::Mat bgr = loadImageForColumns(stillPath, params.columns, cellAspect(), cellSamples(params), false, &factor,
+                                      &sourceSize);
+    if (bgr.empty()) {
+        return false;
+    }
+    stillBgr = bgr;
+    stillDecodeFactor = factor;
+    stillSourceSize = sourceSize;
+    return true;
+}
+
 void MainWindow::refreshAsciiFromStill() {
     if (stillBgr.empty()) {
         return;
     }
+    // passes in flight are for the previous still or font
+    ++stillGeneration;
+    pendingPassParams.reset();
+    if (reducedDecodeFactor(stillSourceSize, params.columns, cellAspect(), cellSamples(params)) != stillDecodeFactor) {
+        loadStill();
+    }
     lastOriginalImage = matToQImage(stillBgr);
     originalView->setPixmap(fitPixmap(lastOriginalImage, originalView->size()));
     runAsciiPipeline(stillBgr);
@@ -176,6 +293,9 @@ void MainWindow::onFrameCaptured(const cv::Mat &frame) {
     lastOriginalImage = matToQImage(frame);
     originalView->setPixmap(fitPixmap(lastOriginalImage, originalView->size()));
     runAsciiPipeline(frame);
+    if (captureWorker) {
+        captureWorker->markFrameConsumed();
+    }
 }
 
 void MainWindow::runAsciiPipeline(const cv::Mat &bgr) {
@@ -184,18 +304,59 @@ void MainWindow::runAsciiPipeline(const cv::Mat &bgr) {
     using std::chrono::duration;
     using std::chrono::milliseconds;
     const auto before = high_resolution_clock::now();
-    // run pipeline
-    auto result = pipeline->process(bgr, params);
-    lastAsciiLines = std::move(result.lines);
-    asciiView->setPixmap(fitPixmap(result.preview, asciiView->size()));
-    middleView->setPixmap(fitPixmap(result.midImage, middleView->size()));
+    // run pipeline, camera frames are pipelined and come out a few frames later
+    std::optional<AsciiPipeline::Result> pipelined;
+    if (mode == Camera) {
+        pipelined = pipeline->submit(bgr, quality.apply(params));
+    } else {
+        pipelined = pipeline->process(bgr, params);
+    }
+    if (!pipelined) {
+        return;
+    }
+    auto &result = *pipelined;
+    // the charset of a recording is fixed, frames of another glyph set are left out
+    if (recorder && result.glyphs.glyphSet() == recorder->charset()) {
+        const auto timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - recordingStart);
+        // encoded and written on the recorder's thread, dropped if it falls behind
+        recorder->push(asciiFrameFromGrid(result.glyphs, timestamp.count()));
+    }
+    lastAsciiGlyphs = result.glyphs;
+    // a static scene leaves the views as they are
+    if (!result.repeated) {
+        asciiView->setPixmap(fitPixmap(result.preview, asciiView->size()));
+        middleView->setPixmap(fitPixmap(result.midImage, middleView->size()));
+    }
     const auto after = high_resolution_clock::now();
     const auto elapsed_ms = duration_cast<milliseconds>(after - before);
-    statusBar()->showMessage(QString("Generated ASCII preview in %1ms").arg(elapsed_ms.count()));
+    QString status = QString("Generated ASCII preview in %1ms").arg(elapsed_ms.count());
+    const auto &gate = pipeline->motionGate();
+    if (mode == Camera && gate.enabled()) {
+        status += QString(" | %1% static frames skipped").arg(100.0 * gate.hitRate(), 0, 'f', 0);
+    }
+    if (mode == Camera) {
+        // per frame interval, the arena idles while frames are in flight on the device
+        auto &host = pipeline->hostExecutor();
+        status += QString(" | host %1% of %2 threads").arg(100.0 * host.utilization(), 0, 'f', 0).arg(host.threads());
+        host.resetUtilization();
+    }
+    if (mode == Camera && quality.enabled()) {
+        // repeated frames cost nothing and say nothing about the budget
+        if (!result.repeated) {
+            quality.record(result.timings);
+        }
+        status += QString(" | %1 (%2 of %3 ms, %4 camera frames skipped)")
+                .arg(quality.describe())
+                .arg(quality.averageMs(), 0, 'f', 1)
+                .arg(quality.target())
+                .arg(captureWorker ? captureWorker->skippedFrames() : 0);
+    }
+    statusBar()->showMessage(status);
 }
 
 void MainWindow::onSaveAscii() {
-    if (lastAsciiLines.empty()) {
+    if (lastAsciiGlyphs.empty()) {
         QMessageBox::information(this, "Save ASCII", "Nothing to save yet.");
         return;
     }
@@ -204,19 +365,50 @@ void MainWindow::onSaveAscii() {
         return;
     }
     QFile file(path);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+    // ASCII glyphs are valid UTF-8 as they are
+    const std::string text = lastAsciiGlyphs.text();
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text) ||
+        file.write(text.data(), static_cast<qint64>(text.size())) != static_cast<qint64>(text.size())) {
         QMessageBox::warning(this, "Save ASCII", "Failed to write file.");
         return;
     }
-    QTextStream out(&file);
-    out.setEncoding(QStringConverter::Utf8);
-    for (const auto &line: lastAsciiLines) {
-        out << line << '\n';
-    };
     file.close();
     statusBar()->showMessage("Saved ASCII to " + path, 3000);
 }
 
+void MainWindow::onToggleRecording(const bool checked) {
+    if (!checked) {
+        if (!recorder) {
+            return;
+        }
+        try {
+            recorder->close();
+        } catch (const std::exception &e) {
+            QMessageBox::warning(this, "Record ASCII", e.what());
+        }
+        statusBar()->showMessage(QString("Recorded %1 frames (%2 dropped, %3 KiB)")
+                                 .arg(recorder->framesWritten())
+                                 .arg(recorder->framesDropped())
+                                 .arg(recorder->bytesWritten() / 1024), 5000);
+        recorder.reset();
+        return;
+    }
+    const QString path = QFileDialog::getSaveFileName(this, "Record ASCII", {}, "ASCII recordings (*.askr)");
+    if (path.isEmpty()) {
+        actRecordAscii->setChecked(false);
+        return;
+    }
+    try {
+        recorder = std::make_unique<AsciiRecordingWriter>(path.toStdString(), params.glyphSet);
+    } catch (const std::exception &e) {
+        QMessageBox::warning(this, "Record ASCII", e.what());
+        actRecordAscii->setChecked(false);
+        return;
+    }
+    recordingStart = std::chrono::steady_clock::now();
+    statusBar()->showMessage("Recording to " + path, 3000);
+}
+
 void MainWindow::onFontChanged() {
     bool ok = false;
     QFont chosen = QFontDialog::getFont(&ok, params.font, this, "Choose monospace font");
@@ -224,22 +416,158 @@ void MainWindow::onFontChanged() {
         return;
     }
     params.font = chosen;
-    ensureCalibrator();
-    pipeline = std::make_unique<AsciiPipeline>(calibrator);
-    if (mode == ImageFile) {
-        refreshAsciiFromStill();
-    }
+    switchGlyphEngine();
 }
 
 
+void MainWindow::onFrameBudgetChanged(QAction *action) {
+    quality.setTarget(action->data().toInt());
+}
+
 void MainWindow::onAdjustParams() {
     ConversionParamsDialog dialog(params, this);
-    if (dialog.exec() == QDialog::Accepted) {
+    // stills follow the controls while the dialog is open, camera frames take the parameters on apply
+    const bool live = mode == ImageFile && !stillBgr.empty();
+    if (live) {
+        connect(&dialog, &ConversionParamsDialog::paramsChanged, this, &MainWindow::onLiveParamsChanged);
+    }
+    const uint64_t openedGeneration = stillGeneration;
+    const bool accepted = dialog.exec() == QDialog::Accepted;
+    const bool unsettled = liveSettleTimer->isActive();
+    livePreviewTimer->stop();
+    liveSettleTimer->stop();
+    proxyBgr.release();
+    if (accepted) {
+        // glyph engines only depend on the font, which the dialog leaves alone
         params = dialog.getParams();
-        ensureCalibrator();
-        pipeline = std::make_unique<AsciiPipeline>(calibrator);
-        if (mode == ImageFile) {
+    }
+    if (mode != ImageFile) {
+        return;
+    }
+    if (!live) {
+        if (accepted) {
             refreshAsciiFromStill();
         }
+        return;
+    }
+    if (accepted && unsettled) {
+        // the last changes were only previewed on the proxy
+        startStillPass(params);
+    } else if (!accepted && stillGeneration != openedGeneration) {
+        // back to the parameters the dialog was opened with
+        ++stillGeneration;
+        pendingPassParams.reset();
+        startStillPass(params);
+    }
+}
+
+void MainWindow::onLiveParamsChanged(const AsciiParams &changed) {
+    liveParams = changed;
+    // a pass for earlier parameters would only be overwritten, it is dropped once done
+    ++stillGeneration;
+    pendingPassParams.reset();
+    // throttled rather than restarted, so a dragged slider keeps updating the preview
+    if (!livePreviewTimer->isActive()) {
+        livePreviewTimer->start();
+    }
+    liveSettleTimer->start();
+}
+
+void MainWindow::onLivePreviewTimeout() {
+    if (mode != ImageFile || stillBgr.empty()) {
+        return;
     }
-}
\ No newline at end of file
+    using std::chrono::duration_cast;
+    using std::chrono::milliseconds;
+    const auto before = std::chrono::steady_clock::now();
+    const int width = std::min(stillBgr.cols, liveParams.columns * LIVE_PREVIEW_PROXY_SCALE);
+    // rebuilt once the columns leave the range it serves, an unchanged proxy keeps the pipeline's memoized stages
+    if (proxyBgr.empty() || proxyBgr.cols < width || proxyBgr.cols > 2 * width) {
+        if (width == stillBgr.cols) {
+            proxyBgr = stillBgr;
+        } else {
+            const int height = std::max(1, static_cast<int>(std::lround(
+                                            static_cast<double>(stillBgr.rows) * width / stillBgr.cols)));
+            cv::resize(stillBgr, proxyBgr, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+        }
+    }
+    // the glyph grid and preview have their full size, only the cell means are taken from fewer pixels
+    const auto result = pipeline->process(proxyBgr, liveParams);
+    asciiView->setPixmap(fitPixmap(result.preview, asciiView->size()));
+    middleView->setPixmap(fitPixmap(result.midImage, middleView->size()));
+    const auto elapsed_ms = duration_cast<milliseconds>(std::chrono::steady_clock::now() - before);
+    statusBar()->showMessage(QString("Previewed on a %1x%2 proxy in %3ms")
+                             .arg(proxyBgr.cols).arg(proxyBgr.rows).arg(elapsed_ms.count()));
+}
+
+void MainWindow::startStillPass(const AsciiParams &passParams) {
+    if (stillBgr.empty()) {
+        return;
+    }
+    if (runningPassGeneration) {
+        pendingPassParams = passParams;
+        return;
+    }
+    if (!stillPipeline) {
+        // proxies convert on the ui thread while a pass runs, the two share the arena's cores
+        stillPipeline = std::make_unique<AsciiPipeline>(pipeline->glyphEngine(), pipeline->sharedHostExecutor());
+    } else if (stillPipeline->glyphEngine() != pipeline->glyphEngine()) {
+        // no pass is running, the font switches on the ui thread like the camera pipeline's
+        stillPipeline->setEngine(pipeline->glyphEngine());
+    }
+    runningPassGeneration = stillGeneration;
+    statusBar()->showMessage("Converting at full resolution...");
+    auto *watcher = new QFutureWatcher<StillPass>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher]() {
+        watcher->deleteLater();
+        const StillPass pass = watcher->result();
+        runningPassGeneration.reset();
+        if (pass.generation == stillGeneration && mode == ImageFile) {
+            if (pass.error.empty()) {
+                stillBgr = pass.bgr;
+                stillDecodeFactor = pass.decodeFactor;
+                stillSourceSize = pass.sourceSize;
+                showStillResult(pass.result);
+            } else {
+                statusBar()->showMessage(QString("Full resolution conversion failed: %1").arg(pass.error.c_str()));
+            }
+        }
+        if (pendingPassParams) {
+            const AsciiParams next = *pendingPassParams;
+            pendingPassParams.reset();
+            startStillPass(next);
+        }
+    });
+    // works on copies, the ui thread may replace the still meanwhile
+    watcher->setFuture(QtConcurrent::run([converter = stillPipeline.get(), path = stillPath, bgr = stillBgr,
+                                             factor = stillDecodeFactor, sourceSize = stillSourceSize, passParams,
+                                             generation = stillGeneration]() mutable {
+        StillPass pass{.generation = generation};
+        try {
+            const double aspect = converter->glyphEngine()->calibrator->cellAspect();
+            const SubCellLayout samples = cellSamples(passParams);
+            if (reducedDecodeFactor(sourceSize, passParams.columns, aspect, samples) != factor) {
+                bgr = loadImageForColumns(path, passParams.columns, aspect, samples, false, &factor, &sourceSize);
+            }
+            if (bgr.empty()) {
+                throw std::runtime_error("failed to load " + path.toStdString());
+            }
+            pass.bgr = bgr;
+            pass.decodeFactor = factor;
+            pass.sourceSize = sourceSize;
+            pass.result = converter->process(bgr, passParams);
+        } catch (const std::exception &e) {
+            pass.error = e.what();
+        }
+        return pass;
+    }));
+}
+
+void MainWindow::showStillResult(const AsciiPipeline::Result &result) {
+    lastAsciiGlyphs = result.glyphs;
+    lastOriginalImage = matToQImage(stillBgr);
+    originalView->setPixmap(fitPixmap(lastOriginalImage, originalView->size()));
+    asciiView->setPixmap(fitPixmap(result.preview, asciiView->size()));
+    middleView->setPixmap(fitPixmap(result.midImage, middleView->size()));
+    statusBar()->showMessage(QString("Converted at full resolution in %1ms").arg(result.timings.busyMs(), 0, 'f', 0));
+}